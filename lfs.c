@@ -1,5 +1,8 @@
 //INCLUDE
 
+#define FUSE_USE_VERSION 29
+#define _GNU_SOURCE
+
 #include <fuse.h>
 #include <errno.h>
 #include <string.h>
@@ -10,52 +13,414 @@
 #include <fcntl.h>
 #include <time.h>
 #include <utime.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
 
 //DEFINE
 
-#define SEGMENT_SIZE 262144             //segment is 1/4 of 1MB. 256 blocks per segment.
-#define NUMBER_OF_SEGMENTS 4            //4 segments makes 1MB
-#define BLOCK_SIZE 1024                 //each block is 1kb
-#define NUMBER_OF_INODES 256            //we can use 32 blocks of each segment to hold inodes.
-#define MAX_LENGTH 56                   //max length to limit size of inodes to 128 bytes
+#define BLOCK_SIZE ((off_t) lfs_geometry.blockSize)   //the geometry is read from the superblock, or chosen by the formatter
+#define SEGMENT_SIZE ((off_t) lfs_geometry.segmentSize)
+#define NUMBER_OF_SEGMENTS lfs_geometry.numberOfSegments
+#define NUMBER_OF_INODES lfs_geometry.numberOfInodes
+#define DEFAULT_BLOCK_SIZE 1024         //each block is 1kb
+#define DEFAULT_SEGMENT_SIZE 262144     //segment is 1/4 of 1MB. 256 blocks per segment.
+#define DEFAULT_SEGMENTS 8              //8 segments makes 2MB
+#define DEFAULT_INODES 256              //the inode map fits in one chunk
+#define MIN_BLOCK_SIZE 1024             //an inode has to fit in a block
+#define MAX_BLOCK_SIZE 4096             //with bigger blocks the blocks of a triple indirect file no longer fit in an int
+#define BLOCKS_PER_SEGMENT ((int)(SEGMENT_SIZE / BLOCK_SIZE))
+#define BLOCKS_OF(bytes) ((int)(((off_t)(bytes) + BLOCK_SIZE - 1) / BLOCK_SIZE))
+#define MAP_ENTRIES ((int)(BLOCK_SIZE / sizeof(int)))  //inode map entries in one chunk, a chunk is one block of the log
+#define MAP_CHUNKS ((NUMBER_OF_INODES + MAP_ENTRIES - 1) / MAP_ENTRIES)
+#define BITMAP_WORDS ((NUMBER_OF_INODES + 63) / 64)
+#define SUMMARY_BLOCK (1 + BLOCKS_OF(MAP_CHUNKS * sizeof(int)))  //first block of the segment summary, after the header and the inode map chunk table
+#define SUMMARY_BLOCKS BLOCKS_OF(BLOCKS_PER_SEGMENT * sizeof(lfs_summary))
+#define SEGMENT_HEADER_BLOCKS (SUMMARY_BLOCK + SUMMARY_BLOCKS)  //the first blocks of each segment hold the segment header, chunk table and summary
+#define SUMMARY_DATA 0                  //summary kinds: a block of file data
+#define SUMMARY_INODE 1                 //an inode
+#define SUMMARY_EXTENTS 2               //an extent block
+#define SUMMARY_INDIRECT 3              //an indirect block, plus its height - 1
+#define SUMMARY_MAP 6                   //a chunk of the inode map, the index is the chunk
+#define SUMMARY_PARTIAL 7               //the header of a partial segment
+#define PARTIAL_HEADER_BLOCKS BLOCKS_OF(sizeof(lfs_partialHeader) + MAP_CHUNKS * sizeof(int) + BLOCK_SIZE / 2)  //a partial segment starts with its header, chunk table and summary
+#define PARTIAL_ENTRIES ((int)((PARTIAL_HEADER_BLOCKS * BLOCK_SIZE - sizeof(lfs_partialHeader) - MAP_CHUNKS * sizeof(int)) / sizeof(lfs_summary)))  //blocks one partial segment can hold
+#define CHECKPOINT_BLOCKS (1 + BLOCKS_OF(MAP_CHUNKS * sizeof(int) + sizeof(int)))
+#define DIRECT_ALIGNMENT 4096           //O_DIRECT needs offsets, sizes and buffers aligned to 4kb
+#define ALIGNED_BLOCKS(blocks) ((int)((((blocks) * BLOCK_SIZE + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT) * (DIRECT_ALIGNMENT / BLOCK_SIZE)))
+#define CHECKPOINT_REGION ALIGNED_BLOCKS(CHECKPOINT_BLOCKS)
+#define CHECKPOINT_START(region) (ALIGNED_BLOCKS(1) + (region) * CHECKPOINT_REGION)
+#define LOG_OFFSET CHECKPOINT_START(2)  //superblock and two checkpoint regions, each on its own aligned blocks
+#define SEGMENT_START(segment) (LOG_OFFSET + (segment) * BLOCKS_PER_SEGMENT)
+#define SEGMENT_OF(block) (((block) - LOG_OFFSET) / BLOCKS_PER_SEGMENT)
+#define IMAGE_SIZE ((off_t) LOG_OFFSET * BLOCK_SIZE + (off_t) NUMBER_OF_SEGMENTS * SEGMENT_SIZE)
+#define FLUSH_QUEUE 2                   //full segments that can be waiting for the flusher thread
+#define LOG_HEADS 3                     //segments appended to at the same time, so each one fills with blocks of a similar age
+#define HEAD_HOT 0                      //log heads: inodes, extent and indirect blocks, rewritten often
+#define HEAD_DATA 1                     //file data
+#define HEAD_COLD 2                     //blocks moved by the cleaner, they already outlived their neighbours
+#define CLEAN_LOW 3                     //the cleaner thread wakes up when fewer segments than this are clean
+#define CLEAN_HIGH 4                    //and keeps cleaning until this many are clean
+#define CLEAN_RESERVE 1                 //clean segments only the cleaner may take, it needs room to move live blocks
+#define INODE_RESERVE 1                 //and above those, segments only changed inodes of the table may take, so the ones kept dirty can always be logged
+#define CLEAN_BATCH 1                   //victims cleaned in one batch, path operations wait at most that long
+#define DIRTY_INODES 128                //changed inodes kept in memory after their last holder, past that they are logged right away
+#define WRITEBACK_INTERVAL 5            //seconds between two write backs of the changed inodes by the cleaner thread
+#define READ_PINS 8                     //segments one reply of read_buf can hand to libfuse as harddisk ranges
+#define PIN_TIMEOUT 2                   //seconds after which the pins of a reader thread that went idle no longer count
+#define LFS_MAGIC 0x4c465336            //"LFS6", summaries, headers and checkpoints carry crc32c checksums
+#define MAX_LENGTH 56                   //max length of a directory or file name
+#define DIRENT_HEADER 8                 //bytes of a directory entry before its name
+#define DIRENT_SIZE(length) ((DIRENT_HEADER + (length) + 3) & ~3)  //entries stay 4 byte aligned
 #define NUMBER_OF_DATAPOINTERS 8        
-#define NUMBER_OF_INDIRECTPOINTERS 32   
-#define HARDDISK "/home/tjohn16/dm510/project4/harddisk.txt"
+#define NUMBER_OF_INDIRECTPOINTERS ((int)(BLOCK_SIZE / sizeof(int)))  //an indirect block is a full block of ints
+#define MAX_BLOCKS (NUMBER_OF_DATAPOINTERS + NUMBER_OF_INDIRECTPOINTERS + NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS + NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS)
+#define EXTENTS_PER_BLOCK ((int)(BLOCK_SIZE / sizeof(lfs_extent)))  //extents that fit in one extent block
+#define INODE_EXTENTS 1                 //inode flag, the file is mapped by an extent list
+#define INODE_INLINE 2                  //inode flag, the data of the file is in the inode itself
+#define INLINE_SIZE 116                 //bytes of data an inode holds, what is left of 256 bytes
+#define INODES_PER_BLOCK ((int)(BLOCK_SIZE / sizeof(inode)))  //inodes packed into one inode block
+#define DENTRY_BUCKETS 1024             //buckets in the (parent, name) hash
+#define PATH_BUCKETS 1024               //buckets in the full path hash
+#define MAX_PATH_ENTRIES 4096           //the path cache is emptied when it grows past this
+#define HARDDISK "harddisk.img"        //default image, relative to the directory lfs is started from
+#define CRC32C_POLY 0x82f63b78         //castagnoli polynomial, bit reflected
+#define CRC_LONG 8192                  //bytes each of the three interleaved crc32 streams takes in one round
+#define CRC_SHORT 256                  //and in the rounds for what is left, a block of 1kb still gets one
+
+//STRUCT EXTENT
+
+typedef struct lfs_extent {
+  int start;                                //first logical block of the run
+  int block;                                //first physical block of the run
+  int length;                               //number of blocks in the run
+} lfs_extent;                               //extent size is 12 bytes
 
 //STRUCT INODE
 
 typedef struct inode {
-  int ID;                                   //ID number, also the number in the inode array
+  int ID;                                   //ID number, also the number in the inode map
   int type;                                 //0 = directory, 1 = file
   char name[MAX_LENGTH];                    //directory or file name, max length is 56
-  int size;                                 //filesize
+  off_t size;                               //filesize, for directories the bytes of their entry blocks
   time_t modify;                            //modification time stamp
   time_t access;                            //access time stamp
-  int datapointer[NUMBER_OF_DATAPOINTERS];  //8 datapointers
-  int indirectDataPointer;                  //indirect data pointer
-} inode;                                    //inode size is 128 bytes
+  int flags;                                //INODE_EXTENTS if the file is mapped by extents, INODE_INLINE if it has no blocks yet
+  int version;                              //log sequence when the inode was created, tells apart the files that had this ID
+  union {
+    struct {                                //block map
+      int datapointer[NUMBER_OF_DATAPOINTERS];  //8 datapointers
+      int indirectDataPointer;              //indirect data pointer, a block of pointers
+      int doubleIndirectDataPointer;        //double indirect data pointer, a block of indirect pointers
+      int tripleIndirectDataPointer;        //triple indirect data pointer, a block of double indirect pointers
+    };
+    struct {                                //extent list
+      int extentCount;                      //number of extents in use
+      int extentPointer;                    //block holding the sorted extents
+    };
+  };
+  char inlineData[INLINE_SIZE];             //data of a small file, zero past its size
+} inode;                                    //inode size is 256 bytes, an ID of -1 marks a free slot of an inode block
+
+//STRUCT SEGMENT SUMMARY
+
+typedef struct lfs_summary {
+  int ID;                                   //inode the block belongs to, -1 for none, inode blocks and inode map chunks
+  int version;                              //version of that inode when the block was written
+  int kind;                                 //what the block holds for the inode
+  int index;                                //logical block in the file, for indirect blocks one of the blocks it maps
+  unsigned int checksum;                    //crc32c of the block, filled in when its partial segment is written
+} lfs_summary;                              //one entry per block of the segment, 20 bytes
+
+//STRUCT OPEN FILE
+
+typedef struct lfs_openFile {
+  int ID;                                   //inode ID of the open file
+  int count;                                //number of handles and callers holding the file
+  int dirty;                                //1 if the pinned inode differs from the logged inode
+  int unlinked;                             //1 if the file was removed while it was open
+  struct lfs_openFile *next;                //next removed file that is still open
+  pthread_rwlock_t lock;                    //shared by readers, exclusive for anything that changes the inode or its blocks
+  inode inode;                              //pinned copy of the inode
+} lfs_openFile;
+
+//STRUCT DIRECTORY BLOCK ENTRY
+
+typedef struct lfs_dirEntry {
+  int ID;                                   //inode ID of the child, -1 for free space
+  unsigned short length;                    //bytes to the next entry, the last one reaches the end of the block
+  unsigned char nameLength;                 //the name is not terminated
+  unsigned char type;                       //type of the child, so lookups never read its inode
+  char name[];
+} lfs_dirEntry;                             //directory blocks are filled with these, an entry never crosses a block
+
+//STRUCT DIRECTORY ENTRY
+
+typedef struct lfs_dentry {
+  int parent;                               //inode ID of the directory
+  int ID;                                   //inode ID of the child
+  int type;                                 //type of the child
+  char name[MAX_LENGTH+1];                  //child name, as stored in the directory block
+  struct lfs_dentry *next;                  //next entry in the same bucket
+} lfs_dentry;
+
+//STRUCT PATH ENTRY
+
+typedef struct lfs_pathEntry {
+  char *path;                               //full path
+  int ID;                                   //inode ID, -1 if the path does not exist
+  struct lfs_pathEntry *next;               //next entry in the same bucket
+} lfs_pathEntry;
+
+//STRUCT SUPERBLOCK
+
+typedef struct lfs_superblock {
+  int magic;                                //LFS_MAGIC
+  int volume;                               //random ID of this file system, stamped on checkpoints and segments
+  int blockSize;                            //geometry the image was formatted with
+  int segmentSize;
+  int numberOfSegments;
+  int numberOfInodes;
+  int logOffset;                            //first block of segment 0
+  int checkpointBlocks;                     //size of one checkpoint region
+  int headerBlocks;                         //blocks at the start of every segment before the first appended one
+} lfs_superblock;
+
+//STRUCT LOG HEAD
+
+typedef struct lfs_logHead {
+  int segment;                              //segment being appended to, -1 until the head is first used
+  int block;                                //next block to append
+  int sequence;                             //sequence number of that segment
+} lfs_logHead;
+
+//STRUCT CHECKPOINT
+
+typedef struct lfs_checkpoint {
+  int magic;                                //LFS_MAGIC
+  int volume;                               //volume ID from the superblock
+  int serial;                               //incremented for every checkpoint, also stored in the last int of the region
+  unsigned int checksum;                    //crc32c of the region, with this field 0
+  time_t time;                              //time the checkpoint was taken
+  int header;                               //serial of the last segment header written before the checkpoint
+  lfs_logHead heads[LOG_HEADS];             //every log head
+} lfs_checkpoint;                           //followed by the inode map chunk table in the next blocks
+
+//STRUCT SEGMENT HEADER
+
+typedef struct lfs_segmentHeader {
+  int magic;                                //LFS_MAGIC
+  int volume;                               //volume ID from the superblock
+  int sequence;                             //incremented every time the log moves to a new segment
+  int blocks;                               //blocks of the segment covered by this header, including the header
+  time_t time;                              //time the header was written
+  int serial;                               //incremented for every header written, the newest inode map has the highest
+  unsigned int checksum;                    //crc32c of the header, chunk table and summary, with this field 0
+  lfs_logHead heads[LOG_HEADS];             //every log head when the inode map was last written completely
+} lfs_segmentHeader;                        //followed by the chunk table of that inode map in the next blocks
+
+//STRUCT PARTIAL SEGMENT HEADER
+
+typedef struct lfs_partialHeader {
+  int magic;                                //LFS_MAGIC
+  int volume;                               //volume ID from the superblock
+  int sequence;                             //sequence number of the segment, every partial segment in it has the same
+  int blocks;                               //blocks after the header that belong to this partial segment
+  int serial;                               //taken from the header serials when it is written, rises along the segment
+  unsigned int checksum;                    //crc32c of the header blocks, with this field 0, its summary has the checksum of every block
+  lfs_logHead heads[LOG_HEADS];             //every log head when the inode map was last written completely
+} lfs_partialHeader;                        //followed by the chunk table of that inode map and the summary of its blocks
+
+//STRUCT SEGMENT USAGE
+
+typedef struct lfs_segmentUsage {
+  int liveBytes;                            //bytes of the segment still referenced by the file system
+  time_t modify;                            //last time a block was appended to the segment
+  int clean;                                //1 if the segment can be reused for the log
+  int readers;                              //replies of read_buf that may still splice from the segment, under the pin lock
+  time_t pinned;                            //when the last of them was handed out
+} lfs_segmentUsage;
+
+//STRUCT FLUSH REQUEST
+
+typedef struct lfs_flushRequest {
+  int segment;                              //full segment to write
+  int first;                                //first block not written yet by a commit, the header and summary always are
+} lfs_flushRequest;
+
+//STRUCT OPTIONS
+
+typedef struct lfs_options {
+  char *image;                              //path of the harddisk image
+  int format;                               //1 to create a new file system even if the image holds one
+  int noExtents;                            //1 to map new files by blocks instead of extents
+  int direct;                               //1 to write the harddisk with O_DIRECT
+  int map;                                  //1 to map the image and use it as the disk in memory
+  int verify;                               //1 to check every checksum of the image and exit, without mounting
+  char *blockSize;                          //geometry of a new file system, sizes take a K, M or G suffix
+  char *segmentSize;
+  char *size;                               //size of the whole image
+  int inodes;
+} lfs_options;
 
 //DEFINE METHODS
 
 int lfs_init(void);
+int lfs_readSuperblock(void);
+int lfs_chooseGeometry(void);
+int lfs_checkGeometry(void);
+int lfs_parseSize(const char *, off_t *);
+int lfs_format(void);
+int lfs_mount(void);
+int lfs_rollForward(void);
+void lfs_findHeads(void);
+void lfs_resumeHeads(void);
+void lfs_dropHeaders(void);
+int lfs_writeLog(void);
+int lfs_writeCheckpoint(void);
+int lfs_writeCheckpointRegion(int *, lfs_logHead *);
+int lfs_commit(void);
+void *lfs_startup(struct fuse_conn_info *);
+void *lfs_flusher(void *);
+void lfs_queueSegment(int, int);
+void lfs_waitSegment(int);
+void lfs_drainFlusher(void);
+void *lfs_backgroundCleaner(void *);
+void lfs_cleanUntil(int);
+int lfs_writeBack(void);
+int lfs_throttle(void);
+void lfs_destroy(void *);
+void lfs_writeSegmentHeader(int, int);
+int lfs_openHarddisk(int);
+int lfs_mapHarddisk(void);
+void lfs_adviseSegment(int, int);
+int lfs_write_blocks(int, int);
 int lfs_getattr( const char *, struct stat * );
+void lfs_fillStat(inode *, struct stat *);
 int lfs_readdir( const char *, void *, fuse_fill_dir_t, off_t, struct fuse_file_info * );
 int lfs_mknod(const char *, mode_t, dev_t);
 int lfs_mkdir(const char *, mode_t);
 int lfs_unlink(const char *);
 int lfs_rmdir(const char *);
 int lfs_rename(const char* from, const char* to);
+int lfs_moveInode(const char *, const char *);
 int lfs_truncate(const char *path, off_t size);
 int lfs_open( const char *, struct fuse_file_info * );
 int lfs_read( const char *, char *, size_t, off_t, struct fuse_file_info * );
+int lfs_read_buf(const char *, struct fuse_bufvec **, size_t, off_t, struct fuse_file_info *);
 int lfs_write (const char *, const char *, size_t, off_t, struct fuse_file_info *);
+int lfs_write_buf(const char *, struct fuse_bufvec *, off_t, struct fuse_file_info *);
 int lfs_release(const char *path, struct fuse_file_info *fi);
-int lfs_findInodeID(char *);
-int lfs_createInode(char *, int);
-int lfs_removeInode(char *);
-int lfs_insertData(char *, int);
+int lfs_flush(const char *path, struct fuse_file_info *fi);
+int lfs_fsync(const char *, int, struct fuse_file_info *);
+int lfs_fsyncdir(const char *, int, struct fuse_file_info *);
+int lfs_ftruncate(const char *path, off_t size, struct fuse_file_info *fi);
+lfs_openFile *lfs_pinInode(int);
+void lfs_unpinInode(lfs_openFile *);
+int lfs_flushInode(lfs_openFile *);
+int lfs_writeInode(inode *, lfs_openFile *);
+inode *lfs_findInode(int, int);
+int lfs_findSlot(int, int);
+int lfs_liveInodes(int);
+void lfs_freeInode(int);
+int lfs_expandInline(lfs_openFile *);
+lfs_openFile *lfs_getOpenFile(const char *, struct fuse_file_info *);
+void lfs_putOpenFile(lfs_openFile *, struct fuse_file_info *);
+inode *lfs_getInode(int, inode *);
+unsigned int lfs_hash(int, const char *);
+int lfs_lookupChild(int, const char *, int *);
+void lfs_cacheDirectory(int);
+void lfs_addDentry(int, int, const char *, int);
+void lfs_removeDentry(int, int);
+void lfs_forgetDirectory(int);
+int lfs_lookupPath(const char *, int *);
+void lfs_addPath(const char *, int);
+void lfs_dropPath(const char *);
+void lfs_clearPaths(void);
+lfs_dirEntry *lfs_nextEntry(inode *, off_t *);
+int lfs_entryMatches(lfs_dirEntry *, const char *);
+int lfs_findRoom(char *, int);
+int lfs_addEntry(lfs_openFile *, const char *, int, int);
+int lfs_removeEntry(lfs_openFile *, const char *);
+int lfs_dropEntry(lfs_openFile *, const char *);
+int lfs_replaceEntry(lfs_openFile *, const char *, int, int);
+int lfs_writeDirectoryBlock(lfs_openFile *, int, char *);
+int lfs_findInodeID(const char *);
+int lfs_getBlockPointer(inode *, int);
+int lfs_setBlockPointer(inode *, int, int);
+int lfs_setIndirectPointer(inode *, int, int *, int, int, int);
+int *lfs_findTree(inode *, int *, int *);
+int lfs_getIndirectBlock(inode *, int, int);
+int lfs_setIndirectChild(inode *, int, int, int);
+int lfs_isUnwritten(int);
+int lfs_updateUnwritten(int, int, const void *, int);
+int lfs_getBlockRun(inode *, int, int, int *);
+int lfs_findExtent(lfs_extent *, int, int);
+int lfs_setExtent(inode *, int, int);
+int lfs_convertToBlockMap(inode *);
+void lfs_freeTree(int, int);
+int lfs_createInode(const char *, int);
+int lfs_removeInode(const char *);
+void lfs_dropInode(int, int);
+int lfs_insertData(char *, int, int, int, int, int);
+int lfs_appendBlock(char *, int, int, int, int, int);
+int lfs_pickHead(int);
+int lfs_placeBlock(int, char *, int, int, int, int, int);
+void lfs_sealSegment(int);
+void lfs_openPartial(int);
+int lfs_closePartials(int);
+lfs_partialHeader *lfs_nextPartial(int, int *, int *, int *);
+int lfs_walkPartials(int, int, int *, int);
+int lfs_segmentEnd(int);
+lfs_partialHeader *lfs_partialAt(int, int, int, int);
+void lfs_sumPartials(int, int);
+int lfs_checkBlocks(int, lfs_summary *, int, int);
+int lfs_validHeader(int);
+int lfs_validCheckpoint(int);
+unsigned int lfs_regionChecksum(const void *, size_t, size_t);
+unsigned int lfs_blockChecksum(int);
+void lfs_initChecksum(void);
+void lfs_crcZeros(unsigned int [][256], size_t);
+unsigned int lfs_crcShift(unsigned int [][256], unsigned int);
+unsigned int lfs_checksum(unsigned int, const void *, size_t);
+unsigned int lfs_checksumTable(unsigned int, const void *, size_t);
+#if defined(__x86_64__)
+unsigned int lfs_checksumHardware(unsigned int, const void *, size_t);
+#endif
+int lfs_verify(void);
+int lfs_verifySegment(int, int);
+int lfs_writeInodeMap(int);
+void lfs_loadInodeMap(int *);
+void lfs_setInodeEntry(int, int);
+int lfs_findFreeInode(void);
+lfs_summary *lfs_getSummary(int);
+int lfs_isLive(int, inode *);
+int lfs_nextSegment(int);
+int lfs_isHead(int);
+int lfs_onHarddisk(int, int);
+int lfs_pinSegment(int);
+void lfs_unpinSegments(void);
+int lfs_isPinned(int);
+int lfs_isDurable(lfs_logHead *);
+void lfs_useBlock(int);
+void lfs_freeBlock(int);
+void lfs_forEachBlock(inode *, void (*)(int));
+void lfs_forEachIndirect(int, int, void (*)(int));
+void lfs_buildUsage(void);
 int lfs_cleaner(void);
-int lfs_write_segment(int, const char *);
+int lfs_pickVictims(char *);
+int lfs_cleanInode(inode *, char *);
+int lfs_cleanIndirect(int *, int, char *);
+int lfs_moveBlock(int);
+void lfs_moveLive(lfs_openFile *, int);
+int lfs_compareOwner(const void *, const void *);
+int lfs_write_segment(int, int);
 int lfs_utime(const char *, struct utimbuf *);
 
 //STRUCT FUSE OPERATIONS
@@ -71,874 +436,5350 @@ static struct fuse_operations lfs_oper = {
 	.truncate = lfs_truncate,         //change filesize
 	.open	= lfs_open,                 //open file
 	.read	= lfs_read,                 //read file
+	.read_buf = lfs_read_buf,         //read file without copying written blocks
 	.write = lfs_write,               //write file
+	.write_buf = lfs_write_buf,       //write file straight from the request buffer
 	.release = lfs_release,           //release file
-	.utime = lfs_utime                //change access time
+	.flush = lfs_flush,               //flush file
+	.fsync = lfs_fsync,               //make a file durable
+	.fsyncdir = lfs_fsyncdir,         //make a directory durable
+	.ftruncate = lfs_ftruncate,       //change filesize of open file
+	.utime = lfs_utime,               //change access time
+	.init = lfs_startup,              //mount, start background threads
+	.destroy = lfs_destroy            //unmount
+};
+
+//STRUCT FUSE OPTIONS
+
+static struct fuse_opt lfs_opts[] = {
+  {"--image=%s", offsetof(lfs_options, image), 1},      //harddisk image
+  {"--format", offsetof(lfs_options, format), 1},       //create a new file system
+  {"--no-extents", offsetof(lfs_options, noExtents), 1}, //map new files by blocks
+  {"--direct", offsetof(lfs_options, direct), 1},       //bypass the page cache
+  {"--mmap", offsetof(lfs_options, map), 1},            //work on the mapped image
+  {"--verify", offsetof(lfs_options, verify), 1},       //check the image offline
+  {"--block-size=%s", offsetof(lfs_options, blockSize), 0}, //geometry used by --format
+  {"--segment-size=%s", offsetof(lfs_options, segmentSize), 0},
+  {"--size=%s", offsetof(lfs_options, size), 0},
+  {"--inodes=%d", offsetof(lfs_options, inodes), 0},
+  FUSE_OPT_END
 };
 
 //GLOBAL VARIABLES
 
-int *lfs_inodeArray;
+int *lfs_inodeArray;                                                //the whole inode map, under the map lock
+char *lfs_mapDirty;                                                 //chunks changed since they were last logged, under the map lock
+uint64_t *lfs_inodeBitmap;                                          //one bit per inode ID in use, under the map lock
+int lfs_freeHint;                                                   //no free ID in the bitmap words before this one
+int *lfs_mapBlocks;                                                 //where each chunk was last logged, under the log lock
+int *lfs_mapSnapshot;                                               //chunk table of the last complete inode map
+lfs_logHead lfs_snapshotHeads[LOG_HEADS];                           //and the log heads right after it was written
+int lfs_mapDirtyCount;                                              //number of chunks set in lfs_mapDirty, under the map lock
+int lfs_mapWriting;                                                 //set while a checkpoint appends the inode map, under the log lock
+int lfs_removing;                                                   //set while a remove rewrites its directory block, under the log lock
+int lfs_writingBack;                                                //set while an inode of the table is appended, under the log lock
+lfs_openFile **lfs_openFiles;
+lfs_openFile *lfs_unlinkedFiles;
+int lfs_idleInodes;                                                 //inodes left in the table without a holder, under the open lock
+lfs_superblock lfs_geometry;                                        //copy of the superblock, all size math is derived from it
+lfs_segmentUsage *lfs_usage;                                        //segment usage table, under the log lock
+int lfs_cleanCount;
+int lfs_cleanerFailed;                                              //set when the cleaner ran out of log
+lfs_dentry *lfs_dentryTable[DENTRY_BUCKETS];
+lfs_pathEntry *lfs_pathTable[PATH_BUCKETS];
+char *lfs_dirCached;
+int lfs_useExtents = 1;
+int lfs_pathEntries;
 void *lfs_disk_in_memory;
-int lfs_segment;
-int lfs_block;
+size_t lfs_mappedSize;                                              //length of the mapped image, 0 for a private copy
+lfs_logHead lfs_heads[LOG_HEADS];                                   //under the log lock
+int lfs_inodeBlocks[LOG_HEADS];                                     //inode block each log head is filling, -1 for none, under the log lock
+int lfs_partialStart[LOG_HEADS];                                    //header of the partial segment each log head is filling, -1 for none
+int lfs_partialFirst[LOG_HEADS];                                    //first partial segment of each log head not written yet
+int lfs_headerSerial;
+int lfs_sequence;
+int lfs_volume;
+int lfs_checkpointSerial;
+int lfs_harddisk = -1;
+lfs_flushRequest lfs_flushQueue[FLUSH_QUEUE];
+int lfs_flushFirst;
+int lfs_flushCount;
+int lfs_flusherRunning;
+int lfs_flusherStop;
+pthread_t lfs_flusherThread;
+pthread_mutex_t lfs_flushLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t lfs_flushWork = PTHREAD_COND_INITIALIZER;
+pthread_cond_t lfs_flushDone = PTHREAD_COND_INITIALIZER;
+int lfs_cleanerRunning;
+int lfs_cleanerStop;                                                //under the log lock, like the wake up flags below
+int lfs_cleanerWanted;
+int lfs_writeBackWanted;                                             //a segment was sealed, the changed inodes should follow it to the log
+int lfs_cleanerStarted;                                             //passes started and finished, a throttled writer waits for the next one
+int lfs_cleanerPasses;
+__thread int lfs_cleaning;                                          //set in the thread running a cleaner batch
+__thread int lfs_threadPins[READ_PINS];                             //segments this thread's last read_buf reply splices from
+__thread int lfs_threadPinCount;
+pthread_cond_t lfs_pinReleased = PTHREAD_COND_INITIALIZER;          //a reader thread let go of its segments
+pthread_t lfs_cleanerThread;
+pthread_cond_t lfs_cleanWork = PTHREAD_COND_INITIALIZER;
+pthread_cond_t lfs_cleanDone = PTHREAD_COND_INITIALIZER;
+int lfs_commitTickets;                                              //fsync callers so far, under the commit lock
+int lfs_commitDone;                                                 //callers covered by a finished commit
+int lfs_commitGood;                                                 //callers covered by a commit that reached the harddisk
+int lfs_committing;                                                 //set while one caller commits for the whole batch
+pthread_cond_t lfs_commitFinished = PTHREAD_COND_INITIALIZER;
+//lock order: namespace, cache, open files, inode, log head, inode map, pins
+pthread_rwlock_t lfs_namespaceLock = PTHREAD_RWLOCK_INITIALIZER;   //shared for lookups, exclusive for create, remove and rename
+pthread_mutex_t lfs_cacheLock = PTHREAD_MUTEX_INITIALIZER;         //dentry and path caches filled by lookups
+pthread_mutex_t lfs_openLock = PTHREAD_MUTEX_INITIALIZER;          //table of pinned inodes and their counts
+pthread_mutex_t lfs_logLock = PTHREAD_MUTEX_INITIALIZER;           //log head, and blocks of the current segment
+pthread_rwlock_t lfs_mapLock = PTHREAD_RWLOCK_INITIALIZER;         //inode map and its free bitmap
+pthread_mutex_t lfs_cleanerLock = PTHREAD_MUTEX_INITIALIZER;       //one cleaner at a time, taken before everything else
+pthread_mutex_t lfs_commitLock = PTHREAD_MUTEX_INITIALIZER;        //group commit tickets, never held together with another lock
+pthread_mutex_t lfs_pinLock = PTHREAD_MUTEX_INITIALIZER;           //segments pinned by read_buf replies, taken last
+lfs_options lfs_config;
+unsigned int lfs_crcTable[8][256];                                  //crc32c of a byte, then of it followed by 1 to 7 zero bytes
+unsigned int lfs_crcLong[4][256];                                   //moves a crc past CRC_LONG zero bytes, a byte of it at a time
+unsigned int lfs_crcShort[4][256];                                  //and past CRC_SHORT zero bytes
+int lfs_crcHardware;                                                //1 if the processor has the crc32 instruction
 
 //INIT METHOD
 
 int lfs_init(void){
   printf("///  INITIALIZING FILE SYSTEM  ///\n");
   
+  //a file system on the harddisk brings its own geometry, a new one is only made with --format and takes it from the options
+  //a superblock that is missing or does not fit this program is never formatted over, the reason was printed
+  if(!lfs_config.format && lfs_readSuperblock() != 0) {
+    fprintf(stderr, "Init: could not mount %s, the harddisk was not changed\n", lfs_config.image);
+    return 1;
+  }
+  if(lfs_config.format && lfs_chooseGeometry() != 0) {
+    return 1;
+  }
   
-  //allocate memory for the array of inodes
-  lfs_inodeArray = malloc(NUMBER_OF_INODES * sizeof(inode));
-  //allocate 1mb of memory for the disk
-  lfs_disk_in_memory = malloc(NUMBER_OF_SEGMENTS * SEGMENT_SIZE);
-  
-  //create harddisk
-  char harddisk[NUMBER_OF_SEGMENTS*SEGMENT_SIZE];
+  //allocate memory for the inode map, its free bitmap and where its chunks are in the log
+  lfs_inodeArray = malloc(NUMBER_OF_INODES * sizeof(int));
+  lfs_inodeBitmap = malloc(BITMAP_WORDS * sizeof(uint64_t));
+  lfs_mapDirty = calloc(MAP_CHUNKS, sizeof(char));
+  lfs_mapBlocks = malloc(MAP_CHUNKS * sizeof(int));
+  lfs_mapSnapshot = malloc(MAP_CHUNKS * sizeof(int));
+  //allocate the table of pinned inodes, indexed by inode ID
+  lfs_openFiles = calloc(NUMBER_OF_INODES, sizeof(lfs_openFile *));
+  lfs_idleInodes = 0;
+  //directories whose children are all in the dentry cache
+  lfs_dirCached = calloc(NUMBER_OF_INODES, sizeof(char));
+  //allocate memory for the whole harddisk image, aligned so segments can be written straight from it
+  //a mapped image needs no copy, format or mount map it once the harddisk has its size
+  if(!lfs_config.map) {
+    if(posix_memalign(&lfs_disk_in_memory, DIRECT_ALIGNMENT, IMAGE_SIZE) != 0) {
+      return 1;
+    }
+    memset(lfs_disk_in_memory, 0, IMAGE_SIZE);
+  }
+  lfs_usage = calloc(NUMBER_OF_SEGMENTS, sizeof(lfs_segmentUsage));
   int h;
-  for (h=0; h<(NUMBER_OF_SEGMENTS*SEGMENT_SIZE); h++) {
-    harddisk[h] = '0';
+  for(h=0; h<LOG_HEADS; h++) {
+    lfs_inodeBlocks[h] = -1;
+    lfs_partialStart[h] = -1;
+    lfs_partialFirst[h] = -1;
   }
   
-  int file;
-  file = creat(HARDDISK, 0777);
-  write(file, harddisk, (NUMBER_OF_SEGMENTS*SEGMENT_SIZE));
-  
-  //set current block and segment 
-  lfs_segment = 0;
-  lfs_block = 32;
-  
-  //initialize array of inodes
-  int i;
-  for(i=0; i<NUMBER_OF_INODES; i++) {
-    lfs_inodeArray[i]=-1;
+  //keep the file system already on the harddisk, a mount that fails leaves it as it is
+  if(!lfs_config.format) {
+    if(lfs_mount() != 0) {
+      fprintf(stderr, "Init: could not mount %s, the harddisk was not changed\n", lfs_config.image);
+      return 1;
+    }
+    printf("FILE SYSTEM MOUNTED\n");
+    
+    return 0;
   }
   
-  //create root inode 
-  inode *lfs_root;
-  lfs_root = malloc(sizeof(inode));
-  
-  lfs_root->ID = 0;
-  lfs_root->type = 0;
-  memset(lfs_root->name, 0, 2);
-  memcpy(lfs_root->name, "/", 2);
-  lfs_root->size = 0;
-  lfs_root->modify = time(NULL);
-  lfs_root->access = time(NULL);
-  
-  int j;
-  for(j=0; j<NUMBER_OF_DATAPOINTERS; j++) {
-    lfs_root->datapointer[j] = -1;
+  if(lfs_format() != 0) {
+    return 1;
   }
   
-  lfs_root->indirectDataPointer = -1;
-  
-  //insert root inode into the disk in memory
-  memset(lfs_disk_in_memory + (lfs_block*BLOCK_SIZE), 0, sizeof(inode));
-  memcpy(lfs_disk_in_memory + (lfs_block*BLOCK_SIZE), (char *) lfs_root, sizeof(inode));
-  lfs_inodeArray[0] = lfs_block;
-  
-  //go to next block 
-  lfs_block++;
-  
   printf("FILE SYSTEM INITIALIZED\n");
   
   return 0;
 }
 
-//GET ATTRIBUTE METHOD
-
-int lfs_getattr( const char *path, struct stat *stbuf ) {
-	printf("getattr method called\n");
-
-	memset(stbuf, 0, sizeof(struct stat));
-	
-	//create an inode pointer
-  inode *lfs_inode;
-  lfs_inode = malloc(sizeof(inode));
+//READ SUPERBLOCK METHOD
 
-  //find the inode
-  int lfs_inodeID;
-  lfs_inodeID = lfs_findInodeID(path);
+int lfs_readSuperblock(void) {
+  printf("readSuperblock method called\n");
   
-  //if there is no inode
-  if(lfs_inodeID == -1) {
-    free(lfs_inode);
+  if(lfs_openHarddisk(0) != 0) {
+    perror("Read Superblock: Could not open harddisk");
+    return 1;
+  }
+  
+  //the superblock sits at the start of the image whatever the block size, read one aligned unit for O_DIRECT
+  void *lfs_unit;
+  if(posix_memalign(&lfs_unit, DIRECT_ALIGNMENT, DIRECT_ALIGNMENT) != 0) {
+    return 1;
+  }
+  ssize_t res;
+  res = pread(lfs_harddisk, lfs_unit, DIRECT_ALIGNMENT, 0);
+  memcpy(&lfs_geometry, lfs_unit, sizeof(lfs_superblock));
+  free(lfs_unit);
+  //every format so far was "LFS" and a version digit, an older one is refused rather than taken for an empty harddisk
+  if(res >= (ssize_t) sizeof(lfs_superblock) && lfs_geometry.magic != LFS_MAGIC && (lfs_geometry.magic >> 8) == (LFS_MAGIC >> 8)) {
+    fprintf(stderr, "Read Superblock: the file system on harddisk was written by an older lfs (format %c), run --verify with the lfs that wrote it or use --format to recreate it\n", (char)(lfs_geometry.magic & 0xff));
+    return 1;
+  }
+  if(res < (ssize_t) sizeof(lfs_superblock) || lfs_geometry.magic != LFS_MAGIC) {
+    fprintf(stderr, "Read Superblock: no file system on harddisk, use --format to create one\n");
+    return 1;
+  }
+  
+  //the layout has to be the one this program derives from the geometry, a different one is refused as it is
+  if(lfs_checkGeometry() != 0 || lfs_geometry.logOffset != LOG_OFFSET || lfs_geometry.checkpointBlocks != CHECKPOINT_BLOCKS || lfs_geometry.headerBlocks != SEGMENT_HEADER_BLOCKS) {
+    fprintf(stderr, "Read Superblock: the file system on harddisk has a layout this lfs does not use, only --format can replace it\n");
     
-    return -ENOENT;
-  } else {
-    //get the inode
-    memset(lfs_inode, 0, sizeof(inode));
-    memcpy(lfs_inode, lfs_disk_in_memory + (lfs_inodeArray[lfs_inodeID] * BLOCK_SIZE), sizeof(inode));
-    
-    //if the inode is a directory
-    if(lfs_inode->type == 0) {
-      stbuf->st_mode = S_IFDIR | 0777;
-      stbuf->st_atime = lfs_inode->access;
-  		stbuf->st_mtime = lfs_inode->modify;
-		  
-		  return 0;
-  	} else if (lfs_inode->type == 1){
-  	  stbuf->st_mode = S_IFREG | 0777;
-  	  stbuf->st_atime = lfs_inode->access;
-  		stbuf->st_mtime = lfs_inode->modify;
-		  stbuf->st_size = lfs_inode->size;
-		  
-		  free(lfs_inode);
-		  
-		  return 0;
-  	}
+    return 1;
   }
+  
   return 0;
 }
 
-//READ DIRECTORY METHOD
-
-int lfs_readdir( const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi ) {
-	printf("readdir method called\n");
+//CHOOSE GEOMETRY METHOD
 
-  filler(buf, ".", NULL, 0);
-	filler(buf, "..", NULL, 0);
-	
-  int lfs_inodeID;
-  lfs_inodeID = lfs_findInodeID(path);
+int lfs_chooseGeometry(void) {
+  printf("chooseGeometry method called\n");
   
-  //get the inode
-  inode *lfs_inode;
-  lfs_inode = malloc(sizeof(inode));
-  memset(lfs_inode, 0, sizeof(inode));
-  memcpy(lfs_inode, lfs_disk_in_memory + (lfs_inodeArray[lfs_inodeID] * BLOCK_SIZE), sizeof(inode));
+  //the formatter options, or the geometry lfs always had
+  off_t lfs_blockSize = DEFAULT_BLOCK_SIZE;
+  off_t lfs_segmentSize = DEFAULT_SEGMENT_SIZE;
+  if((lfs_config.blockSize != NULL && lfs_parseSize(lfs_config.blockSize, &lfs_blockSize) != 0) || (lfs_config.segmentSize != NULL && lfs_parseSize(lfs_config.segmentSize, &lfs_segmentSize) != 0)) {
+    fprintf(stderr, "Choose Geometry: sizes are a number with an optional K, M or G\n");
+    
+    return 1;
+  }
+  if(lfs_blockSize > MAX_BLOCK_SIZE || lfs_segmentSize > INT_MAX) {
+    fprintf(stderr, "Choose Geometry: block size or segment size too large\n");
+    
+    return 1;
+  }
   
-  //read through the inode's datapointers
-  int i;
-  for(i=0; i<NUMBER_OF_DATAPOINTERS; i++) {
-    if(lfs_inode->datapointer[i] != -1) {
-      filler(buf, ((inode*)(lfs_disk_in_memory + (lfs_inodeArray[lfs_inode->datapointer[i]] * BLOCK_SIZE)))->name, NULL, 0);
-    }
+  memset(&lfs_geometry, 0, sizeof(lfs_superblock));
+  lfs_geometry.magic = LFS_MAGIC;
+  lfs_geometry.blockSize = lfs_blockSize;
+  lfs_geometry.segmentSize = lfs_segmentSize;
+  lfs_geometry.numberOfInodes = DEFAULT_INODES;
+  if(lfs_config.inodes != 0) {
+    lfs_geometry.numberOfInodes = lfs_config.inodes;
   }
   
-  //read through the inode's indirectDataPointers
-  if(lfs_inode->indirectDataPointer != -1) {
-    int *lfs_indirectPointersArray;
-    lfs_indirectPointersArray = malloc(NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
-    
-    //get the array of indirectDataPointers from the disk in memory
-    memset(lfs_indirectPointersArray, 0, NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
-    memcpy(lfs_indirectPointersArray, lfs_disk_in_memory + (lfs_inode->indirectDataPointer * BLOCK_SIZE), NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
-    
-    //checking each indirectDataPointer
-    int j;
-    for(j=0; j<NUMBER_OF_INDIRECTPOINTERS; j++) {
-      if(lfs_indirectPointersArray[j] != -1) {
-        filler(buf, ((inode*)(lfs_disk_in_memory + (lfs_inodeArray[lfs_indirectPointersArray[j]] * BLOCK_SIZE)))->name, NULL, 0);
-      }
+  //whatever the image holds after the superblock and checkpoints is cut into segments
+  lfs_geometry.numberOfSegments = DEFAULT_SEGMENTS;
+  if(lfs_config.size != NULL) {
+    off_t lfs_size;
+    if(lfs_parseSize(lfs_config.size, &lfs_size) != 0) {
+      fprintf(stderr, "Choose Geometry: sizes are a number with an optional K, M or G\n");
+      
+      return 1;
     }
-    free(lfs_indirectPointersArray);
+    lfs_size = (lfs_size - LOG_OFFSET * BLOCK_SIZE) / SEGMENT_SIZE;
+    lfs_geometry.numberOfSegments = lfs_size > INT_MAX ? INT_MAX : (lfs_size < 0 ? 0 : lfs_size);
   }
-  free(lfs_inode);
-
-	return 0;
-}
-
-//MKNOD METHOD
-
-int lfs_mknod(const char * path, mode_t mode, dev_t dev) {
-  int res;
-  printf("mknod method called\n");
-  
-  //create the inode
-  res = lfs_createInode(path, 1);
+  lfs_geometry.logOffset = LOG_OFFSET;
+  lfs_geometry.checkpointBlocks = CHECKPOINT_BLOCKS;
+  lfs_geometry.headerBlocks = SEGMENT_HEADER_BLOCKS;
   
-  return res;
+  return lfs_checkGeometry();
 }
 
-//MKDIR METHOD
+//CHECK GEOMETRY METHOD
 
-int lfs_mkdir(const char * path, mode_t mode) {
-  int res;
-  printf("mkdir method called\n");
-  
-  //create the inode
-  res = lfs_createInode(path, 0);
+int lfs_checkGeometry(void) {
+  //block numbers are ints, and every segment needs room for more than its header
+  if(lfs_geometry.blockSize < MIN_BLOCK_SIZE || lfs_geometry.blockSize > MAX_BLOCK_SIZE || (lfs_geometry.blockSize & (lfs_geometry.blockSize - 1)) != 0) {
+    fprintf(stderr, "Check Geometry: unsupported block size %d\n", lfs_geometry.blockSize);
+    return 1;
+  }
+  if(lfs_geometry.segmentSize <= 0 || lfs_geometry.segmentSize % DIRECT_ALIGNMENT != 0 || lfs_geometry.numberOfInodes < 2) {
+    fprintf(stderr, "Check Geometry: unsupported segment size %d or inode count %d\n", lfs_geometry.segmentSize, lfs_geometry.numberOfInodes);
+    return 1;
+  }
+  if((SEGMENT_HEADER_BLOCKS + PARTIAL_HEADER_BLOCKS) * 2 > BLOCKS_PER_SEGMENT) {
+    fprintf(stderr, "Check Geometry: the headers, chunk tables and summary take %d of the %d blocks of a segment\n", SEGMENT_HEADER_BLOCKS + PARTIAL_HEADER_BLOCKS, BLOCKS_PER_SEGMENT);
+    return 1;
+  }
+  if(lfs_geometry.numberOfSegments < LOG_HEADS + CLEAN_HIGH || IMAGE_SIZE / BLOCK_SIZE > INT_MAX) {
+    fprintf(stderr, "Check Geometry: %d segments, the log needs at least %d and at most %d blocks\n", lfs_geometry.numberOfSegments, LOG_HEADS + CLEAN_HIGH, INT_MAX);
+    return 1;
+  }
   
-  return res;
+  return 0;
 }
 
-//UNLINK METHOD
-
-int lfs_unlink(const char * path) {
-  int res;
-  printf("unlink method called\n");
+//PARSE SIZE METHOD
 
-  //remove the inode
-  res = lfs_removeInode(path);
+int lfs_parseSize(const char *text, off_t *size) {
+  //a number of bytes, with an optional binary K, M or G
+  char *lfs_end;
+  long long lfs_value;
+  errno = 0;
+  lfs_value = strtoll(text, &lfs_end, 10);
+  if(errno != 0 || lfs_end == text || lfs_value <= 0) {
+    return 1;
+  }
+  switch(*lfs_end) {
+    case 'G': case 'g': lfs_value *= 1024;
+    case 'M': case 'm': lfs_value *= 1024;
+    case 'K': case 'k': lfs_value *= 1024; lfs_end++;
+    case '\0': break;
+    default: return 1;
+  }
+  if(*lfs_end != '\0') {
+    return 1;
+  }
+  *size = lfs_value;
   
-  return res;
+  return 0;
 }
 
-//RMDIR METHOD
+//FORMAT METHOD
 
-int lfs_rmdir(const char * path) {
+int lfs_format(void) {
+  printf("format method called\n");
+  
+  //create harddisk
+  if(lfs_openHarddisk(O_CREAT | O_TRUNC) != 0 || ftruncate(lfs_harddisk, IMAGE_SIZE) == -1) {
+    perror("Format: Error creating harddisk file");
+    return 1;
+  }
+  if(lfs_config.map && lfs_mapHarddisk() != 0) {
+    return 1;
+  }
+  
+  //write the superblock
+  lfs_volume = (int) time(NULL) ^ (int) getpid();
+  
+  lfs_geometry.volume = lfs_volume;
+  memcpy(lfs_disk_in_memory, &lfs_geometry, sizeof(lfs_superblock));
+  lfs_write_blocks(0, 1);
+  
+  //every segment starts out clean, each log head takes one when it is first written to
+  int h;
+  for(h=0; h<LOG_HEADS; h++) {
+    lfs_heads[h].segment = -1;
+    lfs_heads[h].block = -1;
+    lfs_heads[h].sequence = 0;
+  }
+  lfs_sequence = 0;
+  lfs_headerSerial = 0;
+  lfs_checkpointSerial = 0;
+  
+  int s;
+  for(s=0; s<NUMBER_OF_SEGMENTS; s++) {
+    lfs_usage[s].liveBytes = 0;
+    lfs_usage[s].modify = time(NULL);
+    lfs_usage[s].clean = 1;
+  }
+  lfs_cleanCount = NUMBER_OF_SEGMENTS;
+  
+  //initialize the inode map, no chunk is in the log yet
+  int *lfs_noChunks;
+  lfs_noChunks = malloc(MAP_CHUNKS * sizeof(int));
+  memset(lfs_noChunks, 0xff, MAP_CHUNKS * sizeof(int));
+  lfs_loadInodeMap(lfs_noChunks);
+  free(lfs_noChunks);
+  
+  //create root inode 
+  inode *lfs_root;
+  lfs_root = malloc(sizeof(inode));
+  memset(lfs_root, 0, sizeof(inode));
+  
+  lfs_root->ID = 0;
+  lfs_root->type = 0;
+  memcpy(lfs_root->name, "/", 2);
+  lfs_root->size = 0;
+  lfs_root->flags = 0;
+  lfs_root->modify = time(NULL);
+  lfs_root->access = time(NULL);
+  
+  int j;
+  for(j=0; j<NUMBER_OF_DATAPOINTERS; j++) {
+    lfs_root->datapointer[j] = -1;
+  }
+  
+  lfs_root->indirectDataPointer = -1;
+  lfs_root->doubleIndirectDataPointer = -1;
+  lfs_root->tripleIndirectDataPointer = -1;
+  
+  //insert root inode into the log
+  lfs_writeInode(lfs_root, NULL);
+  free(lfs_root);
+  
+  //make the empty file system durable
   int res;
-  printf("rmdir method called\n");
-
-  //remove the inode
-  res = lfs_removeInode(path);
-
+  pthread_mutex_lock(&lfs_logLock);
+  res = lfs_writeCheckpoint();
+  pthread_mutex_unlock(&lfs_logLock);
+  
   return res;
 }
 
-//RENAME METHOD
+//MOUNT METHOD
 
-int lfs_rename(const char* from, const char* to) {
-  printf("rename method called\n");
+int lfs_mount(void) {
+  printf("mount method called\n");
   
-  //create an inode pointer
-  inode *lfs_inode;
-  lfs_inode = malloc(sizeof(inode));
+  if(lfs_openHarddisk(0) != 0) {
+    return 1;
+  }
   
-  //find the inode
-  int lfs_inodeID;
-  lfs_inodeID = lfs_findInodeID(from);
+  //read the image into the disk in memory, a mapped image is only paged in where it is used
+  off_t lfs_offset = 0;
+  struct stat lfs_stat;
+  if(lfs_config.map) {
+    if(fstat(lfs_harddisk, &lfs_stat) == 0 && lfs_stat.st_size >= IMAGE_SIZE && lfs_mapHarddisk() == 0) {
+      lfs_offset = IMAGE_SIZE;
+    }
+  }
+  while(!lfs_config.map && lfs_offset < IMAGE_SIZE) {
+    ssize_t res;
+    res = pread(lfs_harddisk, lfs_disk_in_memory + lfs_offset, IMAGE_SIZE - lfs_offset, lfs_offset);
+    if(res <= 0) {
+      break;
+    }
+    lfs_offset += res;
+  }
   
-  //get the inode
-  memset(lfs_inode, 0, sizeof(inode));
-  memcpy(lfs_inode, lfs_disk_in_memory + (lfs_inodeArray[lfs_inodeID] * BLOCK_SIZE), sizeof(inode));
-
-  //set the inode name
-  if(strlen(basename(to)) < MAX_LENGTH) {
-    memset(lfs_inode->name, 0, strlen(basename(from)));
-    memcpy(lfs_inode->name, basename(to), strlen(basename(to)));
+  //the geometry was already taken from the superblock, the image has to be as large as it says
+  if(lfs_offset < IMAGE_SIZE) {
+    fprintf(stderr, "Mount: harddisk is shorter than its geometry, use --format to recreate it\n");
+    close(lfs_harddisk);
+    lfs_harddisk = -1;
+    
+    return 1;
   }
-  else {
-    memset(lfs_inode->name, 0, strlen(basename(from)));
-    memcpy(lfs_inode->name, basename(to), MAX_LENGTH);
+  lfs_volume = lfs_geometry.volume;
+  
+  //use the newest checkpoint that was written completely
+  lfs_checkpoint *lfs_best = NULL;
+  int c;
+  for(c=0; c<2; c++) {
+    if(!lfs_validCheckpoint(c)) {
+      continue;
+    }
+    lfs_checkpoint *lfs_cp;
+    lfs_cp = (lfs_checkpoint *)(lfs_disk_in_memory + (CHECKPOINT_START(c) * BLOCK_SIZE));
+    if(lfs_best == NULL || lfs_cp->serial > lfs_best->serial) {
+      lfs_best = lfs_cp;
+    }
+  }
+  if(lfs_best == NULL) {
+    fprintf(stderr, "Mount: no checkpoint on harddisk passes its checksum, run --verify to find the damage or use --format to recreate it\n");
+    
+    return 1;
   }
   
-  //insert the inode into the inode array
-  lfs_inodeArray[lfs_inodeID] = lfs_insertData((char *) lfs_inode, sizeof(inode));
+  //restore the log heads and the inode map
+  memcpy(lfs_heads, lfs_best->heads, sizeof(lfs_heads));
+  lfs_loadInodeMap((int *)(((char *) lfs_best) + BLOCK_SIZE));
+  lfs_headerSerial = lfs_best->header;
+  lfs_checkpointSerial = lfs_best->serial;
   
-  free(lfs_inode);
-  return 0;
-}
-
-//TRUNCATE METHOD
-
-int lfs_truncate(const char *path, off_t size) {
-  int res;
-  printf("truncate method called\n");
+  //pick up segments written after the checkpoint
+  int lfs_rolled;
+  lfs_rolled = lfs_rollForward();
+  lfs_findHeads();
   
-  //create an inode pointer
-  inode *lfs_inode;
-  lfs_inode = malloc(sizeof(inode));
+  //count what the inodes reference, segments nobody references are clean
+  lfs_buildUsage();
   
-  //find the inode
-  int lfs_inodeID;
-  lfs_inodeID = lfs_findInodeID(path);
+  //the log heads go on in new partial segments
+  pthread_mutex_lock(&lfs_logLock);
+  lfs_resumeHeads();
+  pthread_mutex_unlock(&lfs_logLock);
   
-  //get the inode
-  memset(lfs_inode, 0, sizeof(inode));
-  memcpy(lfs_inode, lfs_disk_in_memory + (lfs_inodeArray[lfs_inodeID] * BLOCK_SIZE), sizeof(inode));
-    
-  //set new size
-  lfs_inode->size = size;
-  lfs_inodeArray[lfs_inodeID] = lfs_insertData((char *) lfs_inode, sizeof(inode));
+  //segments the checkpoint still references may be reused from now on, so it has to be replaced
+  pthread_mutex_lock(&lfs_logLock);
+  int lfs_saved = 1;
+  if(lfs_rolled > 0) {
+    lfs_saved = lfs_writeCheckpoint() == 0;
+  }
   
-  free(lfs_inode);
+  //an old header may name the inode map that was rolled forward to, it goes once a checkpoint holds that map
+  if(lfs_saved) {
+    lfs_dropHeaders();
+  }
+  pthread_mutex_unlock(&lfs_logLock);
   
   return 0;
 }
 
-//OPEN METHOD
+//ROLL FORWARD METHOD
 
-int lfs_open( const char *path, struct fuse_file_info *fi ) {
-  int res;
-  printf("open method called\n");
+int lfs_rollForward(void) {
+  printf("rollForward method called\n");
+  
+  //every segment header and partial segment written after the checkpoint can name a newer inode map
+  lfs_logHead *lfs_bestHeads = NULL;
+  int *lfs_bestMap = NULL;
+  int lfs_bestSerial = 0;
+  int lfs_newer = 0;
+  int lfs_maxSerial = lfs_headerSerial;
+  int lfs_maxSequence = 0;
+  int s;
+  for(s=0; s<NUMBER_OF_SEGMENTS; s++) {
+    lfs_segmentHeader *lfs_header;
+    lfs_header = (lfs_segmentHeader *)(lfs_disk_in_memory + (SEGMENT_START(s) * BLOCK_SIZE));
+    if(lfs_validHeader(s)) {
+      if(lfs_header->sequence > lfs_maxSequence) {
+        lfs_maxSequence = lfs_header->sequence;
+      }
+      if(lfs_header->serial > lfs_headerSerial) {
+        lfs_newer++;
+        if(lfs_header->serial > lfs_maxSerial) {
+          lfs_maxSerial = lfs_header->serial;
+        }
+        
+        //the newest one wins, as long as every log head it names reached the harddisk
+        if(lfs_header->serial > lfs_bestSerial && lfs_isDurable(lfs_header->heads)) {
+          lfs_bestHeads = lfs_header->heads;
+          lfs_bestMap = (int *)(((char *) lfs_header) + BLOCK_SIZE);
+          lfs_bestSerial = lfs_header->serial;
+        }
+      }
+    }
+    
+    //the partial segments of a segment that was never filled are found one after the other
+    int lfs_block = SEGMENT_START(s) + SEGMENT_HEADER_BLOCKS;
+    int lfs_sequence = -1;
+    int lfs_serial = 0;
+    lfs_partialHeader *lfs_partial;
+    while((lfs_partial = lfs_nextPartial(s, &lfs_block, &lfs_sequence, &lfs_serial)) != NULL) {
+      if(lfs_partial->sequence > lfs_maxSequence) {
+        lfs_maxSequence = lfs_partial->sequence;
+      }
+      if(lfs_partial->serial <= lfs_headerSerial) {
+        continue;
+      }
+      lfs_newer++;
+      if(lfs_partial->serial > lfs_maxSerial) {
+        lfs_maxSerial = lfs_partial->serial;
+      }
+      if(lfs_partial->serial > lfs_bestSerial && lfs_isDurable(lfs_partial->heads)) {
+        lfs_bestHeads = lfs_partial->heads;
+        lfs_bestMap = (int *)(((char *) lfs_partial) + sizeof(lfs_partialHeader));
+        lfs_bestSerial = lfs_partial->serial;
+      }
+    }
+  }
+  if(lfs_bestHeads != NULL) {
+    memcpy(lfs_heads, lfs_bestHeads, sizeof(lfs_heads));
+    lfs_loadInodeMap(lfs_bestMap);
+  }
+  
+  //headers past the chosen one are never trusted again, and sequence numbers are never reused
+  lfs_headerSerial = lfs_maxSerial;
+  int h;
+  for(h=0; h<LOG_HEADS; h++) {
+    if(lfs_heads[h].sequence > lfs_maxSequence) {
+      lfs_maxSequence = lfs_heads[h].sequence;
+    }
+  }
+  lfs_sequence = lfs_maxSequence;
+  
+  printf("rolled forward through %d headers\n", lfs_newer);
+  
+  return lfs_newer;
+}
 
-  //make sure inode exists
-  res = lfs_findInodeID(path);
-  if(res == -1) {
-    return -ENOENT;
+//IS DURABLE METHOD
+
+int lfs_isDurable(lfs_logHead *heads) {
+  //the inode map and the inodes it names can be in the partial segment of every log head, those blocks must be on the harddisk
+  int h;
+  for(h=0; h<LOG_HEADS; h++) {
+    int lfs_segment = heads[h].segment;
+    if(lfs_segment == -1 || heads[h].block - SEGMENT_START(lfs_segment) <= SEGMENT_HEADER_BLOCKS) {
+      continue;
+    }
+    
+    //a full segment has its header
+    lfs_segmentHeader *lfs_written;
+    lfs_written = (lfs_segmentHeader *)(lfs_disk_in_memory + (SEGMENT_START(lfs_segment) * BLOCK_SIZE));
+    if(lfs_validHeader(lfs_segment) && lfs_written->sequence == heads[h].sequence && SEGMENT_START(lfs_segment) + lfs_written->blocks >= heads[h].block) {
+      continue;
+    }
+    
+    //otherwise its partial segments reach the head, only the header of one with no named blocks yet may be missing
+    int lfs_sequence = heads[h].sequence;
+    if(lfs_walkPartials(lfs_segment, heads[h].block, &lfs_sequence, 0) + PARTIAL_HEADER_BLOCKS < heads[h].block) {
+      return 0;
+    }
   }
   
-	return 0;
+  return 1;
 }
 
-//READ METHOD
+//FIND HEADS METHOD
 
-int lfs_read( const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi ) {
-  int remain;
-  printf("read method called\n");
+void lfs_findHeads(void) {
+  //each log head goes on after the partial segment holding the last block the inode map names
+  //its summary was only written with the partial segments, it is copied back from their headers
+  int h;
+  for(h=0; h<LOG_HEADS; h++) {
+    int lfs_segment = lfs_heads[h].segment;
+    if(lfs_segment == -1) {
+      continue;
+    }
+    int lfs_sequence = lfs_heads[h].sequence;
+    int lfs_reach;
+    lfs_reach = lfs_walkPartials(lfs_segment, lfs_heads[h].block, &lfs_sequence, 1);
+    if(lfs_reach + PARTIAL_HEADER_BLOCKS < lfs_heads[h].block) {
+      fprintf(stderr, "Find Heads: blocks %d to %d of log head %d are missing\n", lfs_reach, lfs_heads[h].block, h);
+    }
+    
+    //whatever was appended after it belongs to no inode
+    int lfs_end = SEGMENT_START(lfs_segment) + BLOCKS_PER_SEGMENT;
+    memset(lfs_getSummary(lfs_reach), 0xff, (lfs_end - lfs_reach) * sizeof(lfs_summary));
+    lfs_heads[h].block = lfs_reach;
+    lfs_partialFirst[h] = lfs_reach;
+  }
+}
+
+//RESUME HEADS METHOD
+
+void lfs_resumeHeads(void) {
+  //the caller holds the log lock, every log head opens a partial segment where it was found
+  int lfs_written = 0;
+  int h;
+  for(h=0; h<LOG_HEADS; h++) {
+    int lfs_segment = lfs_heads[h].segment;
+    if(lfs_segment == -1 || lfs_heads[h].block == SEGMENT_START(lfs_segment) + BLOCKS_PER_SEGMENT) {
+      continue;
+    }
+    lfs_openPartial(h);
+    if(lfs_heads[h].block == SEGMENT_START(lfs_segment) + BLOCKS_PER_SEGMENT) {
+      //no room for another partial segment
+      lfs_sealSegment(h);
+      continue;
+    }
+    
+    //a partial segment written there before the crash must not be taken for the next one
+    lfs_write_blocks(lfs_partialStart[h], PARTIAL_HEADER_BLOCKS);
+    lfs_written = 1;
+  }
+  if(lfs_written) {
+    fdatasync(lfs_harddisk);
+  }
+}
+
+//DROP HEADERS METHOD
+
+void lfs_dropHeaders(void) {
+  //the caller holds the log lock, a header sealed before still vouches for the blocks the log heads now write over
+  int lfs_written = 0;
+  int h;
+  for(h=0; h<LOG_HEADS; h++) {
+    int lfs_segment = lfs_heads[h].segment;
+    if(lfs_segment == -1) {
+      continue;
+    }
+    lfs_segmentHeader *lfs_header;
+    lfs_header = (lfs_segmentHeader *)(lfs_disk_in_memory + (SEGMENT_START(lfs_segment) * BLOCK_SIZE));
+    if(lfs_header->magic != LFS_MAGIC) {
+      continue;
+    }
+    
+    //without its magic the segment ends where its partial segments do
+    lfs_header->magic = 0;
+    lfs_write_blocks(SEGMENT_START(lfs_segment), 1);
+    lfs_written = 1;
+  }
+  if(lfs_written) {
+    fdatasync(lfs_harddisk);
+  }
+}
+
+//VERIFY METHOD
+
+int lfs_verify(void) {
+  printf("verify method called\n");
   
-  //create an inode pointer
-  inode *lfs_inode;
-  lfs_inode = malloc(sizeof(inode));
+  //the image is mapped and read front to back, the next segment is read ahead while one is checked
+  if(lfs_readSuperblock() != 0) {
+    fprintf(stderr, "Verify: could not read the superblock\n");
+    return 1;
+  }
+  struct stat lfs_stat;
+  if(fstat(lfs_harddisk, &lfs_stat) != 0 || lfs_stat.st_size < IMAGE_SIZE) {
+    fprintf(stderr, "Verify: harddisk is shorter than its geometry\n");
+    return 1;
+  }
+  if(lfs_mapHarddisk() != 0) {
+    return 1;
+  }
+  madvise(lfs_disk_in_memory, IMAGE_SIZE, MADV_SEQUENTIAL);
+  lfs_volume = lfs_geometry.volume;
   
-  //find the inode
-  int lfs_inodeID;
-  lfs_inodeID = lfs_findInodeID(path);
+  //a region never written is no damage, as long as one checkpoint is whole
+  int lfs_errors = 0;
+  int lfs_checkpoints = 0;
+  lfs_checkpoint *lfs_best = NULL;
+  int c;
+  for(c=0; c<2; c++) {
+    lfs_checkpoint *lfs_cp;
+    lfs_cp = (lfs_checkpoint *)(lfs_disk_in_memory + (CHECKPOINT_START(c) * BLOCK_SIZE));
+    if(lfs_validCheckpoint(c)) {
+      lfs_checkpoints++;
+      if(lfs_best == NULL || lfs_cp->serial > lfs_best->serial) {
+        lfs_best = lfs_cp;
+      }
+    } else if(lfs_cp->magic == LFS_MAGIC) {
+      printf("checkpoint region %d does not match its checksum\n", c);
+      lfs_errors++;
+    }
+  }
+  if(lfs_checkpoints == 0) {
+    printf("no valid checkpoint\n");
+    lfs_errors++;
+  }
   
-  //get the inode
-  memset(lfs_inode, 0, sizeof(inode));
-  memcpy(lfs_inode, lfs_disk_in_memory + (lfs_inodeArray[lfs_inodeID] * BLOCK_SIZE), sizeof(inode));
+  //the segments the log heads were appending to are still open, whatever header they hold is an old one
+  int h;
+  for(h=0; h<LOG_HEADS; h++) {
+    lfs_heads[h].segment = lfs_best != NULL ? lfs_best->heads[h].segment : -1;
+  }
+  
+  int s;
+  for(s=0; s<NUMBER_OF_SEGMENTS; s++) {
+    if(s + 1 < NUMBER_OF_SEGMENTS) {
+      lfs_adviseSegment(s + 1, MADV_WILLNEED);
+    }
+    lfs_errors += lfs_verifySegment(s, lfs_isHead(s) != -1);
+    lfs_adviseSegment(s, MADV_DONTNEED);
+  }
+  
+  printf("verified %d checkpoints and %d segments, %d errors\n", lfs_checkpoints, NUMBER_OF_SEGMENTS, lfs_errors);
+  munmap(lfs_disk_in_memory, lfs_mappedSize);
+  lfs_mappedSize = 0;
+  close(lfs_harddisk);
+  lfs_harddisk = -1;
+  
+  return lfs_errors > 0;
+}
+
+//VERIFY SEGMENT METHOD
+
+int lfs_verifySegment(int segment, int open) {
+  //a full segment is checked against its own summary, one still being filled against the summaries of its partial segments
+  int lfs_errors = 0;
+  lfs_segmentHeader *lfs_header;
+  lfs_header = (lfs_segmentHeader *)(lfs_disk_in_memory + (SEGMENT_START(segment) * BLOCK_SIZE));
+  int lfs_sealed;
+  lfs_sealed = !open && lfs_validHeader(segment);
+  if(!open && !lfs_sealed && lfs_header->magic == LFS_MAGIC && lfs_header->volume == lfs_volume) {
+    printf("segment %d: header does not match its checksum\n", segment);
+    lfs_errors++;
+  }
+  
+  //the headers of the partial segments, one that goes on the chain but is not whole was torn or damaged
+  int lfs_block = SEGMENT_START(segment) + SEGMENT_HEADER_BLOCKS;
+  int lfs_sequence = -1;
+  int lfs_serial = 0;
+  lfs_partialHeader *lfs_partial;
+  while((lfs_partial = lfs_partialAt(segment, lfs_block, lfs_sequence, lfs_serial)) != NULL) {
+    lfs_sequence = lfs_partial->sequence;
+    lfs_serial = lfs_partial->serial;
+    lfs_block += PARTIAL_HEADER_BLOCKS + lfs_partial->blocks;
+  }
+  lfs_partial = (lfs_partialHeader *)(lfs_disk_in_memory + (lfs_block * BLOCK_SIZE));
+  if(lfs_block + PARTIAL_HEADER_BLOCKS < SEGMENT_START(segment) + BLOCKS_PER_SEGMENT && lfs_partial->magic == LFS_MAGIC && lfs_partial->volume == lfs_volume && (lfs_sequence == -1 || lfs_partial->sequence == lfs_sequence) && lfs_partial->serial > lfs_serial) {
+    printf("segment %d: partial segment at block %d does not match its checksum\n", segment, lfs_block);
+    lfs_errors++;
+  }
+  
+  //the blocks, against the summary of the newest use of the segment
+  if(lfs_sealed && (lfs_sequence == -1 || lfs_sequence <= lfs_header->sequence)) {
+    int lfs_blocks = lfs_header->blocks < BLOCKS_PER_SEGMENT ? lfs_header->blocks : BLOCKS_PER_SEGMENT;
+    int lfs_first = SEGMENT_START(segment) + SEGMENT_HEADER_BLOCKS;
+    lfs_errors += lfs_checkBlocks(lfs_first, lfs_getSummary(lfs_first), lfs_blocks - SEGMENT_HEADER_BLOCKS, 1);
+    
+    return lfs_errors;
+  }
+  int lfs_end = lfs_block;
+  lfs_block = SEGMENT_START(segment) + SEGMENT_HEADER_BLOCKS;
+  lfs_serial = 0;
+  while(lfs_block < lfs_end) {
+    lfs_partial = lfs_partialAt(segment, lfs_block, lfs_sequence, lfs_serial);
+    lfs_serial = lfs_partial->serial;
+    lfs_summary *lfs_entries;
+    lfs_entries = (lfs_summary *)(((char *) lfs_partial) + sizeof(lfs_partialHeader) + MAP_CHUNKS * sizeof(int));
+    lfs_errors += lfs_checkBlocks(lfs_block + PARTIAL_HEADER_BLOCKS, lfs_entries, lfs_partial->blocks, 1);
+    lfs_block += PARTIAL_HEADER_BLOCKS + lfs_partial->blocks;
+  }
+  
+  return lfs_errors;
+}
+
+//WRITE LOG METHOD
+
+int lfs_writeLog(void) {
+  printf("writeLog method called\n");
+  
+  //the caller holds the log lock, so the log heads stay where they are
+  //the changed chunks of the inode map go to the log first, into as many segments as they need
+  int h;
+  h = lfs_cleaning ? HEAD_COLD : HEAD_HOT;
+  lfs_mapWriting = 1;
+  while(1) {
+    int lfs_done;
+    int lfs_before = lfs_heads[h].block;
+    lfs_done = lfs_writeInodeMap(h) == 0;
+    if(lfs_heads[h].block != lfs_before && lfs_heads[h].block == SEGMENT_START(lfs_heads[h].segment) + BLOCKS_PER_SEGMENT) {
+      //the chunks filled the segment
+      lfs_sealSegment(h);
+    }
+    if(lfs_done) {
+      break;
+    }
+    if((lfs_heads[h].segment == -1 || lfs_heads[h].block == SEGMENT_START(lfs_heads[h].segment) + BLOCKS_PER_SEGMENT) && lfs_nextSegment(h) != 0) {
+      lfs_mapWriting = 0;
+      
+      return 1;
+    }
+  }
+  lfs_mapWriting = 0;
   
-  remain = lfs_inode->size;
+  //segments handed to the flusher come before the partial segments
+  lfs_drainFlusher();
   
-  //read data
-  int i=0;
-  while(remain > BLOCK_SIZE && i<NUMBER_OF_DATAPOINTERS) {
-    memset(buf + (i*BLOCK_SIZE), 0, BLOCK_SIZE);
-    memcpy(buf + (i*BLOCK_SIZE), lfs_disk_in_memory + (lfs_inode->datapointer[i] * BLOCK_SIZE), BLOCK_SIZE);
+  //everything the inode map points to has to be on the harddisk, only the partial segments no commit wrote yet go out
+  for(h=0; h<LOG_HEADS; h++) {
+    int lfs_segment = lfs_heads[h].segment;
+    if(lfs_segment == -1) {
+      continue;
+    }
+    int lfs_first;
+    lfs_first = lfs_closePartials(h);
+    lfs_sumPartials(lfs_first, lfs_partialFirst[h]);
+    if(lfs_partialFirst[h] > lfs_first && lfs_write_blocks(lfs_first, lfs_partialFirst[h] - lfs_first) != 0) {
+      return 1;
+    }
     
-    remain -= BLOCK_SIZE;
-    i++;
+    //the head goes on in a new partial segment, without room for one the segment is full
+    if(lfs_partialStart[h] == -1 && lfs_heads[h].block < SEGMENT_START(lfs_segment) + BLOCKS_PER_SEGMENT) {
+      lfs_openPartial(h);
+      if(lfs_heads[h].block == SEGMENT_START(lfs_segment) + BLOCKS_PER_SEGMENT) {
+        lfs_sealSegment(h);
+      }
+    }
+  }
+  if(fdatasync(lfs_harddisk) != 0) {
+    return 1;
+  }
+  
+  return 0;
+}
+
+//WRITE CHECKPOINT METHOD
+
+int lfs_writeCheckpoint(void) {
+  printf("writeCheckpoint method called\n");
+  
+  //everything the inode map points to has to be on the harddisk first, in every log head
+  if(lfs_writeLog() != 0) {
+    return 1;
+  }
+  
+  //the checkpoint names the map the partial segments named, and where the log heads were then
+  return lfs_writeCheckpointRegion(lfs_mapSnapshot, lfs_snapshotHeads);
+}
+
+//WRITE CHECKPOINT REGION METHOD
+
+int lfs_writeCheckpointRegion(int *mapBlocks, lfs_logHead *heads) {
+  //build the checkpoint in place, alternating between the two regions
+  lfs_checkpointSerial++;
+  
+  int lfs_regionBlock;
+  lfs_regionBlock = CHECKPOINT_START(lfs_checkpointSerial % 2);
+  char *lfs_region;
+  lfs_region = lfs_disk_in_memory + (lfs_regionBlock * BLOCK_SIZE);
+  memset(lfs_region, 0, CHECKPOINT_REGION * BLOCK_SIZE);
+  
+  lfs_checkpoint *lfs_cp;
+  lfs_cp = (lfs_checkpoint *) lfs_region;
+  lfs_cp->magic = LFS_MAGIC;
+  lfs_cp->volume = lfs_volume;
+  lfs_cp->serial = lfs_checkpointSerial;
+  lfs_cp->time = time(NULL);
+  lfs_cp->header = lfs_headerSerial;
+  memcpy(lfs_cp->heads, heads, sizeof(lfs_heads));
+  memcpy(lfs_region + BLOCK_SIZE, mapBlocks, MAP_CHUNKS * sizeof(int));
+  *(int *)(lfs_region + (CHECKPOINT_BLOCKS * BLOCK_SIZE) - sizeof(int)) = lfs_checkpointSerial;
+  lfs_cp->checksum = lfs_regionChecksum(lfs_region, CHECKPOINT_BLOCKS * BLOCK_SIZE, offsetof(lfs_checkpoint, checksum));
+  
+  int res;
+  res = lfs_write_blocks(lfs_regionBlock, CHECKPOINT_REGION);
+  if(res == 0) {
+    res = fdatasync(lfs_harddisk);
   }
   
-  if( i < NUMBER_OF_DATAPOINTERS) {
-    //remaining data is within datapointers
-    memset(buf + (i*BLOCK_SIZE), 0, remain);
-    memcpy(buf + (i*BLOCK_SIZE), lfs_disk_in_memory + (lfs_inode->datapointer[i] * BLOCK_SIZE), remain);
+  return res;
+}
+
+//COMMIT METHOD
+
+int lfs_commit(void) {
+  printf("commit method called\n");
+  
+  //callers arriving while a commit runs are covered together by the next one
+  pthread_mutex_lock(&lfs_commitLock);
+  int lfs_ticket = ++lfs_commitTickets;
+  while(lfs_commitDone < lfs_ticket) {
+    if(lfs_committing) {
+      pthread_cond_wait(&lfs_commitFinished, &lfs_commitLock);
+      continue;
+    }
     
-    remain = lfs_inode->size;
+    //no commit running, this caller writes the log for every ticket taken so far
+    int lfs_batch = lfs_commitTickets;
+    lfs_committing = 1;
+    pthread_mutex_unlock(&lfs_commitLock);
     
-    free(lfs_inode);
+    int res;
+    pthread_mutex_lock(&lfs_logLock);
+    res = lfs_writeLog();
+    pthread_mutex_unlock(&lfs_logLock);
     
-    return remain;
+    pthread_mutex_lock(&lfs_commitLock);
+    lfs_committing = 0;
+    lfs_commitDone = lfs_batch;
+    if(res == 0) {
+      lfs_commitGood = lfs_batch;
+    }
+    pthread_cond_broadcast(&lfs_commitFinished);
   }
   
-  int *lfs_indirectPointersArray;
-  lfs_indirectPointersArray = (int *)(lfs_disk_in_memory + (lfs_inode->indirectDataPointer * BLOCK_SIZE));
+  //a later checkpoint that reached the harddisk also covers a batch whose own commit failed
+  int lfs_durable = lfs_commitGood >= lfs_ticket;
+  pthread_mutex_unlock(&lfs_commitLock);
   
-  int l = 0;
-  while(remain > BLOCK_SIZE) {
-    memset(buf + (i*BLOCK_SIZE), 0, BLOCK_SIZE);
-    memcpy(buf + (i*BLOCK_SIZE), lfs_disk_in_memory + (lfs_indirectPointersArray[l] * BLOCK_SIZE), BLOCK_SIZE);
-    remain -= BLOCK_SIZE;
-    
-    i++;
-    l++;
+  return lfs_durable ? 0 : -EIO;
+}
+
+//STARTUP METHOD
+
+void *lfs_startup(struct fuse_conn_info *conn) {
+  printf("startup method called\n");
+  
+  //threads have to be started after fuse has daemonized
+  lfs_flusherStop = 0;
+  if(pthread_create(&lfs_flusherThread, NULL, lfs_flusher, NULL) == 0) {
+    lfs_flusherRunning = 1;
+  } else {
+    perror("Startup: Could not start the segment flusher, writing segments synchronously");
   }
   
-  memset(buf + (i*BLOCK_SIZE), 0, remain);
-  memcpy(buf + (i*BLOCK_SIZE), lfs_disk_in_memory + (lfs_indirectPointersArray[l] * BLOCK_SIZE), remain);
+  //the cleaner starts right away if the mounted log is already short of clean segments
+  pthread_mutex_lock(&lfs_logLock);
+  lfs_cleanerStop = 0;
+  lfs_cleanerWanted = lfs_cleanCount < CLEAN_LOW;
+  pthread_mutex_unlock(&lfs_logLock);
+  if(pthread_create(&lfs_cleanerThread, NULL, lfs_backgroundCleaner, NULL) == 0) {
+    lfs_cleanerRunning = 1;
+  } else {
+    perror("Startup: Could not start the cleaner, cleaning only when the log is full");
+  }
   
-  remain = lfs_inode->size;
-	
-	free(lfs_inode);
-	
-	return remain;
+  return NULL;
 }
 
-//WRITE METHOD
+//FLUSHER METHOD
 
-int lfs_write(const char * path, const char * buf, size_t size, off_t offset, struct fuse_file_info * fi) {
-  int remain;
-  printf("write method called\n");
+void *lfs_flusher(void *arg) {
+  pthread_mutex_lock(&lfs_flushLock);
+  while(1) {
+    while(lfs_flushCount == 0 && !lfs_flusherStop) {
+      pthread_cond_wait(&lfs_flushWork, &lfs_flushLock);
+    }
+    if(lfs_flushCount == 0) {
+      break;
+    }
+    lfs_flushRequest lfs_request;
+    lfs_request = lfs_flushQueue[lfs_flushFirst];
+    pthread_mutex_unlock(&lfs_flushLock);
+    
+    //the segment is full and nobody writes to it while it is queued
+    //its header names the inode map the next mount rolls forward to
+    lfs_write_segment(lfs_request.segment, lfs_request.first);
+    
+    pthread_mutex_lock(&lfs_flushLock);
+    lfs_flushFirst = (lfs_flushFirst + 1) % FLUSH_QUEUE;
+    lfs_flushCount--;
+    pthread_cond_broadcast(&lfs_flushDone);
+  }
+  pthread_mutex_unlock(&lfs_flushLock);
   
-  //create an inode pointer
-  inode *lfs_inode;
-  lfs_inode = malloc(sizeof(inode));
+  return NULL;
+}
+
+//QUEUE SEGMENT METHOD
+
+void lfs_queueSegment(int segment, int first) {
+  //without the flusher thread the segment is written right away
+  if(!lfs_flusherRunning) {
+    lfs_write_segment(segment, first);
+    return;
+  }
   
-  //find the inode
-  int lfs_inodeID;
-  lfs_inodeID = lfs_findInodeID(path);
+  pthread_mutex_lock(&lfs_flushLock);
   
-  //get the inode
-  memset(lfs_inode, 0, sizeof(inode));
-  memcpy(lfs_inode, lfs_disk_in_memory + (lfs_inodeArray[lfs_inodeID] * BLOCK_SIZE), sizeof(inode));
+  //backpressure only when every buffer is already in flight
+  while(lfs_flushCount == FLUSH_QUEUE) {
+    pthread_cond_wait(&lfs_flushDone, &lfs_flushLock);
+  }
   
-  remain = size;
-  int i = 0;
-  while(remain > BLOCK_SIZE && i < NUMBER_OF_DATAPOINTERS) {
-    lfs_inode->datapointer[i] = lfs_insertData((char *) buf + (i*BLOCK_SIZE), BLOCK_SIZE);
-    remain -= BLOCK_SIZE;
-    i++;
+  lfs_flushRequest *lfs_request;
+  lfs_request = &lfs_flushQueue[(lfs_flushFirst + lfs_flushCount) % FLUSH_QUEUE];
+  lfs_request->segment = segment;
+  lfs_request->first = first;
+  lfs_flushCount++;
+  
+  pthread_cond_signal(&lfs_flushWork);
+  pthread_mutex_unlock(&lfs_flushLock);
+}
+
+//WAIT SEGMENT METHOD
+
+void lfs_waitSegment(int segment) {
+  //a segment can only be reused once the flusher is done with it
+  pthread_mutex_lock(&lfs_flushLock);
+  int i;
+  for(i=0; i<lfs_flushCount; i++) {
+    if(lfs_flushQueue[(lfs_flushFirst + i) % FLUSH_QUEUE].segment == segment) {
+      pthread_cond_wait(&lfs_flushDone, &lfs_flushLock);
+      i = -1;
+    }
+  }
+  pthread_mutex_unlock(&lfs_flushLock);
+}
+
+//DRAIN FLUSHER METHOD
+
+void lfs_drainFlusher(void) {
+  pthread_mutex_lock(&lfs_flushLock);
+  while(lfs_flushCount > 0) {
+    pthread_cond_wait(&lfs_flushDone, &lfs_flushLock);
+  }
+  pthread_mutex_unlock(&lfs_flushLock);
+}
+
+//BACKGROUND CLEANER METHOD
+
+void *lfs_backgroundCleaner(void *arg) {
+  pthread_mutex_lock(&lfs_logLock);
+  while(1) {
+    //changed inodes go to the log every few seconds and after each sealed segment, even while nothing needs cleaning
+    struct timespec lfs_deadline;
+    clock_gettime(CLOCK_REALTIME, &lfs_deadline);
+    lfs_deadline.tv_sec += WRITEBACK_INTERVAL;
+    int lfs_timedOut = 0;
+    while(!lfs_cleanerWanted && !lfs_writeBackWanted && !lfs_cleanerStop && !lfs_timedOut) {
+      lfs_timedOut = pthread_cond_timedwait(&lfs_cleanWork, &lfs_logLock, &lfs_deadline) == ETIMEDOUT;
+    }
+    if(lfs_cleanerStop) {
+      break;
     }
+    lfs_writeBackWanted = 0;
+    if(!lfs_cleanerWanted) {
+      pthread_mutex_unlock(&lfs_logLock);
+      lfs_writeBack();
+      pthread_mutex_lock(&lfs_logLock);
+      continue;
+    }
+    lfs_cleanerWanted = 0;
+    lfs_cleanerStarted++;
+    pthread_mutex_unlock(&lfs_logLock);
     
-    if(i < NUMBER_OF_DATAPOINTERS) {
-      //write remaining data to datapointer
-      lfs_inode-> datapointer[i] = lfs_insertData((char *) buf + (i*BLOCK_SIZE), remain);
-    } else {
-      //more than one block of data remaining, write to indirectDataPointers
-      int *lfs_indirectPointersArray = malloc(NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
-      
-      int l;
-      for(l=0; l<NUMBER_OF_INDIRECTPOINTERS; l++) {
-        lfs_indirectPointersArray[l] = -1;
-      }
-      int k = 0;
-      while (remain > BLOCK_SIZE && k < NUMBER_OF_INDIRECTPOINTERS) {
-        lfs_indirectPointersArray[k] = lfs_insertData((char *) buf + (i*BLOCK_SIZE), BLOCK_SIZE);
-        remain -= BLOCK_SIZE;
-        i++;
-        k++;
+    //small batches, writers keep appending in between
+    lfs_cleanUntil(CLEAN_HIGH);
+    
+    pthread_mutex_lock(&lfs_logLock);
+    lfs_cleanerPasses++;
+    pthread_cond_broadcast(&lfs_cleanDone);
+  }
+  pthread_mutex_unlock(&lfs_logLock);
+  
+  return NULL;
+}
+
+//CLEAN UNTIL METHOD
+
+void lfs_cleanUntil(int target) {
+  //every segment is cleaned at most once a pass, so live data is not copied around in circles
+  int i;
+  for(i=0; i<NUMBER_OF_SEGMENTS; i+=CLEAN_BATCH) {
+    int lfs_done;
+    pthread_mutex_lock(&lfs_logLock);
+    lfs_done = lfs_cleanCount >= target || lfs_cleanerStop;
+    pthread_mutex_unlock(&lfs_logLock);
+    if(lfs_done || lfs_cleaner() == 0) {
+      break;
+    }
+  }
+  
+  //inodes the full log kept from being logged go out now that there is room
+  lfs_writeBack();
+}
+
+//WRITE BACK METHOD
+
+int lfs_writeBack(void) {
+  //log every changed inode in the table, an unheld one is dropped from it afterwards
+  //returns the first error, the inodes the full log kept from being logged stay dirty in the table
+  int lfs_result = 0;
+  int i;
+  for(i=0; i<NUMBER_OF_INODES; i++) {
+    lfs_openFile *lfs_file = NULL;
+    pthread_mutex_lock(&lfs_openLock);
+    if(lfs_openFiles[i] != NULL) {
+      lfs_file = lfs_openFiles[i];
+      if(lfs_file->count++ == 0) {
+        lfs_idleInodes--;
       }
-      if(k < NUMBER_OF_INDIRECTPOINTERS) {
-        lfs_indirectPointersArray[k] = lfs_insertData((char *) buf + (i*BLOCK_SIZE), remain);
-        lfs_inode->indirectDataPointer = lfs_insertData((char *) lfs_indirectPointersArray, NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
+    }
+    pthread_mutex_unlock(&lfs_openLock);
+    if(lfs_file != NULL) {
+      int res;
+      pthread_rwlock_wrlock(&lfs_file->lock);
+      res = lfs_flushInode(lfs_file);
+      pthread_rwlock_unlock(&lfs_file->lock);
+      lfs_unpinInode(lfs_file);
+      if(res != 0 && lfs_result == 0) {
+        lfs_result = res;
       }
-      free(lfs_indirectPointersArray);
     }
-    
-  lfs_inode->size = size;
-  lfs_inodeArray[lfs_inodeID] = lfs_insertData((char *) lfs_inode, sizeof(inode));
-  
-  free(lfs_inode);
+  }
   
-  return size;
+  return lfs_result;
 }
 
+//THROTTLE METHOD
 
-//RELEASE METHOD
+int lfs_throttle(void) {
+  //the log is full, the caller holds no lock and waits for one cleaner pass
+  printf("throttle method called\n");
+  
+  int lfs_room;
+  pthread_mutex_lock(&lfs_logLock);
+  if(lfs_cleanerRunning) {
+    int lfs_pass = lfs_cleanerStarted + 1;
+    lfs_cleanerWanted = 1;
+    pthread_cond_signal(&lfs_cleanWork);
+    while(lfs_cleanerPasses < lfs_pass && lfs_cleanCount <= CLEAN_RESERVE + INODE_RESERVE && lfs_cleanerRunning) {
+      pthread_cond_wait(&lfs_cleanDone, &lfs_logLock);
+    }
+  } else {
+    pthread_mutex_unlock(&lfs_logLock);
+    lfs_cleanUntil(CLEAN_LOW);
+    pthread_mutex_lock(&lfs_logLock);
+  }
+  lfs_room = lfs_cleanCount > CLEAN_RESERVE + INODE_RESERVE;
+  pthread_mutex_unlock(&lfs_logLock);
+  
+  return lfs_room;
+}
 
-int lfs_release(const char *path, struct fuse_file_info *fi) {
+//DESTROY METHOD
+
+void lfs_destroy(void *private_data) {
+  printf("destroy method called\n");
+  
+  //stop the cleaner between two batches, the log is not cleaned any further
+  if(lfs_cleanerRunning) {
+    pthread_mutex_lock(&lfs_logLock);
+    lfs_cleanerStop = 1;
+    pthread_cond_signal(&lfs_cleanWork);
+    pthread_mutex_unlock(&lfs_logLock);
+    pthread_join(lfs_cleanerThread, NULL);
+    pthread_mutex_lock(&lfs_logLock);
+    lfs_cleanerRunning = 0;
+    lfs_cleanerStop = 0;
+    pthread_cond_broadcast(&lfs_cleanDone);
+    pthread_mutex_unlock(&lfs_logLock);
+  }
+  
+  //log changed inodes, also those still pinned by open files, a full log is cleaned in this thread until they fit
   int res;
-	printf("release method called\n");
+  int lfs_room = 1;
+  res = lfs_writeBack();
+  while(res != 0 && lfs_room) {
+    lfs_room = lfs_throttle();
+    res = lfs_writeBack();
+  }
   
-  //make sure inode exists
-  res = lfs_findInodeID(path);
-  if(res == -1) {
-    return -ENOENT;
+  //write the partial segment and a checkpoint so the next mount finds everything
+  //a checkpoint without the inodes still dirty would drop them for good, roll forward still finds what was committed
+  if(res == 0) {
+    pthread_mutex_lock(&lfs_logLock);
+    lfs_writeCheckpoint();
+    pthread_mutex_unlock(&lfs_logLock);
+  } else {
+    fprintf(stderr, "Destroy: the log is full, changed inodes could not be logged and no checkpoint was written\n");
   }
-	
-	return 0;
+  
+  //stop the flusher, its queue is empty after the checkpoint
+  if(lfs_flusherRunning) {
+    pthread_mutex_lock(&lfs_flushLock);
+    lfs_flusherStop = 1;
+    pthread_cond_signal(&lfs_flushWork);
+    pthread_mutex_unlock(&lfs_flushLock);
+    pthread_join(lfs_flusherThread, NULL);
+    lfs_flusherRunning = 0;
+  }
+  
+  //the checkpoint wrote every page back, the mapping can go
+  if(lfs_mappedSize != 0) {
+    munmap(lfs_disk_in_memory, lfs_mappedSize);
+    lfs_mappedSize = 0;
+    lfs_disk_in_memory = NULL;
+  }
+  
+  close(lfs_harddisk);
+  lfs_harddisk = -1;
 }
 
-//FIND INODE ID METHOD
+//GET ATTRIBUTE METHOD
 
-int lfs_findInodeID(char *path) {
-  int res = 0;
-  printf("findInodeID method called\n");
+int lfs_getattr( const char *path, struct stat *stbuf ) {
+	printf("getattr method called\n");
+
+	memset(stbuf, 0, sizeof(struct stat));
+
+  //find the inode
+  int lfs_inodeID;
+  pthread_rwlock_rdlock(&lfs_namespaceLock);
+  lfs_inodeID = lfs_findInodeID(path);
   
-  //check if the given path is root
-  if(strcmp("/", path) == 0) {
-    //the root will always be at index 0
+  //if there is no inode
+  if(lfs_inodeID == -1) {
+    pthread_rwlock_unlock(&lfs_namespaceLock);
+    
+    return -ENOENT;
+  }
+  
+  //get the inode, an open file's pinned copy is the newest version
+  inode lfs_inode;
+  if(lfs_getInode(lfs_inodeID, &lfs_inode) == NULL) {
+    pthread_rwlock_unlock(&lfs_namespaceLock);
+    
+    return -ENOENT;
+  }
+  pthread_rwlock_unlock(&lfs_namespaceLock);
+  
+  lfs_fillStat(&lfs_inode, stbuf);
+  return 0;
+}
+
+//FILL STAT METHOD
+
+void lfs_fillStat(inode *lfs_inode, struct stat *stbuf) {
+  //getattr and readdir describe an inode the same way
+  if(lfs_inode->type == 0) {
+    stbuf->st_mode = S_IFDIR | 0777;
+  } else if(lfs_inode->type == 1) {
+    stbuf->st_mode = S_IFREG | 0777;
+  }
+  stbuf->st_ino = lfs_inode->ID;
+  stbuf->st_nlink = 1;
+  stbuf->st_atime = lfs_inode->access;
+  stbuf->st_mtime = lfs_inode->modify;
+  stbuf->st_size = lfs_inode->size;
+}
+
+//READ DIRECTORY METHOD
+
+int lfs_readdir( const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi ) {
+	printf("readdir method called\n");
+	
+  //the directory's blocks only change under the exclusive namespace lock
+  int lfs_inodeID;
+  pthread_rwlock_rdlock(&lfs_namespaceLock);
+  lfs_inodeID = lfs_findInodeID(path);
+  if(lfs_inodeID == -1) {
+    pthread_rwlock_unlock(&lfs_namespaceLock);
+    
+    return -ENOENT;
+  }
+  
+  //get the inode
+  inode lfs_inode;
+  if(lfs_getInode(lfs_inodeID, &lfs_inode) == NULL) {
+    pthread_rwlock_unlock(&lfs_namespaceLock);
+    
+    return -ENOENT;
+  }
+  
+  //offsets 1 and 2 are the dot entries, every other offset is the byte position behind an entry plus 2
+  struct stat lfs_stat;
+  memset(&lfs_stat, 0, sizeof(struct stat));
+  lfs_fillStat(&lfs_inode, &lfs_stat);
+  if(offset < 1 && filler(buf, ".", &lfs_stat, 1)) {
+    pthread_rwlock_unlock(&lfs_namespaceLock);
+    
+    return 0;
+  }
+  if(offset < 2 && filler(buf, "..", NULL, 2)) {
+    pthread_rwlock_unlock(&lfs_namespaceLock);
+    
+    return 0;
+  }
+  
+  //stream the entries from where the last call stopped, each child's stat comes from its inode so no path is resolved again
+  off_t lfs_offset = offset > 2 ? offset - 2 : 0;
+  lfs_dirEntry *lfs_entry;
+  while((lfs_entry = lfs_nextEntry(&lfs_inode, &lfs_offset)) != NULL) {
+    char lfs_name[MAX_LENGTH+1];
+    memcpy(lfs_name, lfs_entry->name, lfs_entry->nameLength);
+    lfs_name[lfs_entry->nameLength] = '\0';
+    
+    //an entry whose child is gone from the inode map is not listed
+    inode lfs_child;
+    if(lfs_getInode(lfs_entry->ID, &lfs_child) == NULL) {
+      continue;
+    }
+    memset(&lfs_stat, 0, sizeof(struct stat));
+    lfs_fillStat(&lfs_child, &lfs_stat);
+    
+    //a full buffer ends this call, the kernel asks again from the last offset it got
+    if(filler(buf, lfs_name, &lfs_stat, lfs_offset + 2)) {
+      break;
+    }
+  }
+  pthread_rwlock_unlock(&lfs_namespaceLock);
+
+	return 0;
+}
+
+//MKNOD METHOD
+
+int lfs_mknod(const char * path, mode_t mode, dev_t dev) {
+  int res;
+  printf("mknod method called\n");
+  
+  //create the inode
+  pthread_rwlock_wrlock(&lfs_namespaceLock);
+  res = lfs_createInode(path, 1);
+  pthread_rwlock_unlock(&lfs_namespaceLock);
+  
+  //the log is full, try once more after the cleaner made room
+  if(res == -ENOSPC && lfs_throttle()) {
+    pthread_rwlock_wrlock(&lfs_namespaceLock);
+    res = lfs_createInode(path, 1);
+    pthread_rwlock_unlock(&lfs_namespaceLock);
+  }
+  
+  return res;
+}
+
+//MKDIR METHOD
+
+int lfs_mkdir(const char * path, mode_t mode) {
+  int res;
+  printf("mkdir method called\n");
+  
+  //create the inode
+  pthread_rwlock_wrlock(&lfs_namespaceLock);
+  res = lfs_createInode(path, 0);
+  pthread_rwlock_unlock(&lfs_namespaceLock);
+  
+  //the log is full, try once more after the cleaner made room
+  if(res == -ENOSPC && lfs_throttle()) {
+    pthread_rwlock_wrlock(&lfs_namespaceLock);
+    res = lfs_createInode(path, 0);
+    pthread_rwlock_unlock(&lfs_namespaceLock);
+  }
+  
+  return res;
+}
+
+//UNLINK METHOD
+
+int lfs_unlink(const char * path) {
+  int res;
+  printf("unlink method called\n");
+
+  //remove the inode
+  pthread_rwlock_wrlock(&lfs_namespaceLock);
+  res = lfs_removeInode(path);
+  pthread_rwlock_unlock(&lfs_namespaceLock);
+  
+  return res;
+}
+
+//RMDIR METHOD
+
+int lfs_rmdir(const char * path) {
+  int res;
+  printf("rmdir method called\n");
+
+  //remove the inode
+  pthread_rwlock_wrlock(&lfs_namespaceLock);
+  res = lfs_removeInode(path);
+  pthread_rwlock_unlock(&lfs_namespaceLock);
+
+  return res;
+}
+
+//RENAME METHOD
+
+int lfs_rename(const char* from, const char* to) {
+  int res;
+  printf("rename method called\n");
+  
+  //no other path operation runs until the rename is done
+  pthread_rwlock_wrlock(&lfs_namespaceLock);
+  res = lfs_moveInode(from, to);
+  pthread_rwlock_unlock(&lfs_namespaceLock);
+  
+  //the log is full, try once more after the cleaner made room, a failed move changed no name
+  if(res == -ENOSPC && lfs_throttle()) {
+    pthread_rwlock_wrlock(&lfs_namespaceLock);
+    res = lfs_moveInode(from, to);
+    pthread_rwlock_unlock(&lfs_namespaceLock);
+  }
+  
+  return res;
+}
+
+//MOVE INODE METHOD
+
+int lfs_moveInode(const char *from, const char *to) {
+  //the caller holds the namespace lock for writing
+  //find the inode
+  int lfs_inodeID;
+  lfs_inodeID = lfs_findInodeID(from);
+  if(lfs_inodeID == -1) {
+    return -ENOENT;
+  }
+  
+  //find both parents
+  char *lfs_from;
+  lfs_from = malloc(strlen(from)+1);
+  memcpy(lfs_from, from, strlen(from)+1);
+  int lfs_parentInodeID;
+  lfs_parentInodeID = lfs_findInodeID(dirname(lfs_from));
+  memcpy(lfs_from, from, strlen(from)+1);
+  
+  char *lfs_to;
+  lfs_to = malloc(strlen(to)+1);
+  memcpy(lfs_to, to, strlen(to)+1);
+  int lfs_targetParentID;
+  lfs_targetParentID = lfs_findInodeID(dirname(lfs_to));
+  memcpy(lfs_to, to, strlen(to)+1);
+  
+  //an existing target is replaced, a directory only by an empty directory and a file only by a file
+  int res = 0;
+  int lfs_targetID;
+  lfs_targetID = lfs_findInodeID(to);
+  inode lfs_source;
+  inode lfs_target;
+  off_t lfs_offset = 0;
+  int lfs_length = strlen(from);
+  if(lfs_targetParentID == -1 || lfs_getInode(lfs_inodeID, &lfs_source) == NULL) {
+    res = -ENOENT;
+  } else if(lfs_source.type == 0 && strncmp(to, from, lfs_length) == 0 && to[lfs_length] == '/') {
+    //a directory cannot move below itself, it would be cut off from the root
+    res = -EINVAL;
+  } else if(lfs_targetID != -1 && lfs_targetID != lfs_inodeID) {
+    if(lfs_getInode(lfs_targetID, &lfs_target) == NULL) {
+      res = -ENOENT;
+    } else if(lfs_source.type == 0 && lfs_target.type != 0) {
+      res = -ENOTDIR;
+    } else if(lfs_source.type != 0 && lfs_target.type == 0) {
+      res = -EISDIR;
+    } else if(lfs_target.type == 0 && lfs_nextEntry(&lfs_target, &lfs_offset) != NULL) {
+      res = -ENOTEMPTY;
+    }
+  } else {
+    lfs_targetID = -1;
+  }
+  if(res != 0 || lfs_targetID == lfs_inodeID) {
+    free(lfs_from);
+    free(lfs_to);
+    
+    return res;
+  }
+  
+  //get the inode
+  lfs_openFile *lfs_file;
+  lfs_file = lfs_pinInode(lfs_inodeID);
+  int lfs_type = lfs_file->inode.type;
+  
+  //the new entry goes in first, taking over the target's entry, a full log leaves both names in place
+  lfs_openFile *lfs_parent;
+  lfs_parent = lfs_pinInode(lfs_targetParentID);
+  pthread_rwlock_wrlock(&lfs_parent->lock);
+  if(lfs_parent->inode.type != 0) {
+    res = -ENOTDIR;
+  } else if(lfs_targetID != -1) {
+    res = lfs_replaceEntry(lfs_parent, basename(lfs_to), lfs_inodeID, lfs_type);
+  } else {
+    res = lfs_addEntry(lfs_parent, basename(lfs_to), lfs_inodeID, lfs_type);
+  }
+  pthread_rwlock_unlock(&lfs_parent->lock);
+  lfs_unpinInode(lfs_parent);
+  if(res == 0) {
+    lfs_parent = lfs_pinInode(lfs_parentInodeID);
+    pthread_rwlock_wrlock(&lfs_parent->lock);
+    res = lfs_dropEntry(lfs_parent, basename(lfs_from));
+    pthread_rwlock_unlock(&lfs_parent->lock);
+    lfs_unpinInode(lfs_parent);
+    
+    //give the new name back to the target, or take it back, so the inode keeps a single entry
+    if(res != 0) {
+      lfs_parent = lfs_pinInode(lfs_targetParentID);
+      pthread_rwlock_wrlock(&lfs_parent->lock);
+      if(lfs_targetID != -1) {
+        lfs_replaceEntry(lfs_parent, basename(lfs_to), lfs_targetID, lfs_target.type);
+      } else {
+        lfs_dropEntry(lfs_parent, basename(lfs_to));
+      }
+      pthread_rwlock_unlock(&lfs_parent->lock);
+      lfs_unpinInode(lfs_parent);
+      lfs_forgetDirectory(lfs_targetParentID);
+    }
+  }
+  
+  //the replaced target has no entry left
+  if(res == 0 && lfs_targetID != -1) {
+    lfs_dropInode(lfs_targetID, lfs_targetParentID);
+  }
+  
+  //set the inode name
+  if(res == 0) {
+    pthread_rwlock_wrlock(&lfs_file->lock);
+    memset(lfs_file->inode.name, 0, MAX_LENGTH);
+    strncpy(lfs_file->inode.name, basename(lfs_to), MAX_LENGTH);
+    lfs_file->dirty = 1;
+    pthread_rwlock_unlock(&lfs_file->lock);
+  }
+  
+  //the child is now found under its new name, and no old path is valid
+  lfs_removeDentry(lfs_parentInodeID, lfs_inodeID);
+  if(res == 0 && lfs_dirCached[lfs_targetParentID]) {
+    lfs_addDentry(lfs_targetParentID, lfs_inodeID, basename(lfs_to), lfs_type);
+  } else if(res != 0) {
+    lfs_forgetDirectory(lfs_parentInodeID);
+  }
+  lfs_clearPaths();
+  
+  //the inode is logged by a write back once nobody holds it anymore
+  lfs_unpinInode(lfs_file);
+  
+  free(lfs_from);
+  free(lfs_to);
+  return res;
+}
+
+//TRUNCATE METHOD
+
+int lfs_truncate(const char *path, off_t size) {
+  printf("truncate method called\n");
+  
+  return lfs_ftruncate(path, size, NULL);
+}
+
+//FTRUNCATE METHOD
+
+int lfs_ftruncate(const char *path, off_t size, struct fuse_file_info *fi) {
+  printf("ftruncate method called\n");
+  
+  //get the open file
+  lfs_openFile *lfs_file;
+  lfs_file = lfs_getOpenFile(path, fi);
+  if(lfs_file == NULL) {
+    return -ENOENT;
+  }
+  
+  //a directory only changes through its entries
+  if(lfs_file->inode.type == 0) {
+    lfs_putOpenFile(lfs_file, fi);
+    
+    return -EISDIR;
+  }
+    
+  pthread_rwlock_wrlock(&lfs_file->lock);
+  
+  //inline data only has to be cleared past the new end, a file growing past the inode gets its first block
+  if((lfs_file->inode.flags & INODE_INLINE) && size > INLINE_SIZE) {
+    int res;
+    res = lfs_expandInline(lfs_file);
+    if(res != 0) {
+      pthread_rwlock_unlock(&lfs_file->lock);
+      lfs_putOpenFile(lfs_file, fi);
+      
+      return res;
+    }
+  }
+  if((lfs_file->inode.flags & INODE_INLINE) && size < lfs_file->inode.size) {
+    memset(lfs_file->inode.inlineData + size, 0, lfs_file->inode.size - size);
+  }
+  
+  //the last kept block is cut the same way, so growing the file again reads zeros behind the new end
+  int lfs_tail = -1;
+  if(!(lfs_file->inode.flags & INODE_INLINE) && size < lfs_file->inode.size && size % BLOCK_SIZE != 0) {
+    lfs_tail = lfs_getBlockPointer(&lfs_file->inode, size / BLOCK_SIZE);
+  }
+  if(lfs_tail != -1) {
+    int lfs_offset = size % BLOCK_SIZE;
+    char *lfs_blockData;
+    lfs_blockData = malloc(BLOCK_SIZE);
+    memcpy(lfs_blockData, lfs_disk_in_memory + (lfs_tail * BLOCK_SIZE), lfs_offset);
+    memset(lfs_blockData + lfs_offset, 0, BLOCK_SIZE - lfs_offset);
+    
+    //a block still only in memory is cut in place, otherwise the cut copy is appended to the log
+    if(!lfs_updateUnwritten(lfs_tail, lfs_offset, lfs_blockData + lfs_offset, BLOCK_SIZE - lfs_offset)) {
+      int res;
+      int lfs_blockPointer;
+      lfs_blockPointer = lfs_insertData(lfs_blockData, BLOCK_SIZE, lfs_file->inode.ID, lfs_file->inode.version, SUMMARY_DATA, size / BLOCK_SIZE);
+      res = lfs_blockPointer == -1 ? -ENOSPC : lfs_setBlockPointer(&lfs_file->inode, size / BLOCK_SIZE, lfs_blockPointer);
+      if(res != 0) {
+        //the file is left as it was
+        if(lfs_blockPointer != -1) {
+          lfs_freeBlock(lfs_blockPointer);
+        }
+        free(lfs_blockData);
+        pthread_rwlock_unlock(&lfs_file->lock);
+        lfs_putOpenFile(lfs_file, fi);
+        
+        return res;
+      }
+    }
+    free(lfs_blockData);
+  }
+  
+  //blocks past the new end are garbage, the last ones go first so an extent list only shrinks
+  int lfs_index;
+  lfs_index = (lfs_file->inode.size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  while(lfs_index > (size + BLOCK_SIZE - 1) / BLOCK_SIZE) {
+    lfs_index--;
+    if(lfs_getBlockPointer(&lfs_file->inode, lfs_index) != -1) {
+      int res;
+      res = lfs_setBlockPointer(&lfs_file->inode, lfs_index, -1);
+      if(res != 0) {
+        //the block stays mapped, so the file keeps its size, the blocks already dropped read as holes
+        lfs_file->dirty = 1;
+        pthread_rwlock_unlock(&lfs_file->lock);
+        lfs_putOpenFile(lfs_file, fi);
+        
+        return res;
+      }
+    }
+  }
+  
+  //an emptied file keeps its next small content in the inode again
+  if(size == 0 && (lfs_file->inode.flags & INODE_EXTENTS) && lfs_file->inode.extentCount == 0) {
+    lfs_freeBlock(lfs_file->inode.extentPointer);
+    lfs_file->inode.extentPointer = -1;
+    lfs_file->inode.flags |= INODE_INLINE;
+  }
+  
+  //set new size
+  lfs_file->inode.size = size;
+  lfs_file->inode.modify = time(NULL);
+  lfs_file->dirty = 1;
+  pthread_rwlock_unlock(&lfs_file->lock);
+  
+  lfs_putOpenFile(lfs_file, fi);
+  
+  return 0;
+}
+
+//OPEN METHOD
+
+int lfs_open( const char *path, struct fuse_file_info *fi ) {
+  printf("open method called\n");
+
+  //make sure inode exists
+  int lfs_inodeID;
+  pthread_rwlock_rdlock(&lfs_namespaceLock);
+  lfs_inodeID = lfs_findInodeID(path);
+  if(lfs_inodeID == -1) {
+    pthread_rwlock_unlock(&lfs_namespaceLock);
+    
+    return -ENOENT;
+  }
+  
+  //pin the inode and hand it to the data operations through the file handle
+  fi->fh = (uint64_t) (uintptr_t) lfs_pinInode(lfs_inodeID);
+  pthread_rwlock_unlock(&lfs_namespaceLock);
+  
+	return 0;
+}
+
+//READ METHOD
+
+int lfs_read( const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi ) {
+  size_t done;
+  printf("read method called\n");
+  
+  //get the open file
+  lfs_openFile *lfs_file;
+  lfs_file = lfs_getOpenFile(path, fi);
+  if(lfs_file == NULL) {
+    return -ENOENT;
+  }
+  
+  //readers of the same file share the lock, readers of different files never meet
+  inode *lfs_inode;
+  lfs_inode = &lfs_file->inode;
+  pthread_rwlock_rdlock(&lfs_file->lock);
+  
+  //nothing to read at or past the end of the file
+  if(offset >= lfs_inode->size) {
+    pthread_rwlock_unlock(&lfs_file->lock);
+    lfs_putOpenFile(lfs_file, fi);
+    
+    return 0;
+  }
+  
+  //never serve more than the file holds
+  if(offset + size > lfs_inode->size) {
+    size = lfs_inode->size - offset;
+  }
+  
+  //a small file is read from the inode itself
+  done = 0;
+  if(lfs_inode->flags & INODE_INLINE) {
+    memcpy(buf, lfs_inode->inlineData + offset, size);
+    done = size;
+  }
+  
+  //copy only the blocks that overlap the requested range
+  while(done < size) {
+    int lfs_index = (offset + done) / BLOCK_SIZE;
+    int lfs_blockOffset = (offset + done) % BLOCK_SIZE;
+    size_t length = BLOCK_SIZE - lfs_blockOffset;
+    if(length > size - done) {
+      length = size - done;
+    }
+    
+    //find the physically contiguous run of blocks that starts here
+    int lfs_run;
+    int lfs_blockPointer;
+    lfs_blockPointer = lfs_getBlockRun(lfs_inode, lfs_index, (lfs_blockOffset + (size - done) + BLOCK_SIZE - 1) / BLOCK_SIZE, &lfs_run);
+    if(lfs_blockPointer == -1) {
+      //hole in the file, reads as zeros
+      memset(buf + done, 0, length);
+    } else {
+      //one copy for the whole run
+      length = (size_t) lfs_run * BLOCK_SIZE - lfs_blockOffset;
+      if(length > size - done) {
+        length = size - done;
+      }
+      memcpy(buf + done, lfs_disk_in_memory + (lfs_blockPointer * BLOCK_SIZE) + lfs_blockOffset, length);
+    }
+    
+    done += length;
+  }
+	pthread_rwlock_unlock(&lfs_file->lock);
+	
+	lfs_putOpenFile(lfs_file, fi);
+	
+	return done;
+}
+
+//READ BUF METHOD
+
+int lfs_read_buf(const char *path, struct fuse_bufvec **bufp, size_t size, off_t offset, struct fuse_file_info *fi) {
+  size_t done;
+  printf("read_buf method called\n");
+  
+  //get the open file
+  lfs_openFile *lfs_file;
+  lfs_file = lfs_getOpenFile(path, fi);
+  if(lfs_file == NULL) {
+    return -ENOENT;
+  }
+  
+  //libfuse sent the last reply of this thread before it took this request, its segments may be reused again
+  lfs_unpinSegments();
+  
+  inode *lfs_inode;
+  lfs_inode = &lfs_file->inode;
+  pthread_rwlock_rdlock(&lfs_file->lock);
+  
+  //never serve more than the file holds
+  if(offset >= lfs_inode->size) {
+    size = 0;
+  } else if(offset + size > lfs_inode->size) {
+    size = lfs_inode->size - offset;
+  }
+  
+  //at most one buffer per block, fuse frees the vector and the memory of every buffer
+  size_t lfs_pieces = (offset % BLOCK_SIZE + size + BLOCK_SIZE - 1) / BLOCK_SIZE + 1;
+  struct fuse_bufvec *lfs_bufv;
+  lfs_bufv = malloc(sizeof(struct fuse_bufvec) + lfs_pieces * sizeof(struct fuse_buf));
+  memset(lfs_bufv, 0, sizeof(struct fuse_bufvec));
+  
+  //a small file is copied out of the inode in one buffer
+  done = 0;
+  if((lfs_inode->flags & INODE_INLINE) && size > 0) {
+    memset(&lfs_bufv->buf[0], 0, sizeof(struct fuse_buf));
+    lfs_bufv->buf[0].fd = -1;
+    lfs_bufv->buf[0].mem = malloc(size);
+    memcpy(lfs_bufv->buf[0].mem, lfs_inode->inlineData + offset, size);
+    lfs_bufv->buf[0].size = size;
+    lfs_bufv->count = 1;
+    done = size;
+  }
+  
+  while(done < size) {
+    int lfs_index = (offset + done) / BLOCK_SIZE;
+    int lfs_blockOffset = (offset + done) % BLOCK_SIZE;
+    size_t length = BLOCK_SIZE - lfs_blockOffset;
+    if(length > size - done) {
+      length = size - done;
+    }
+    
+    struct fuse_buf *lfs_buf;
+    lfs_buf = &lfs_bufv->buf[lfs_bufv->count];
+    memset(lfs_buf, 0, sizeof(struct fuse_buf));
+    lfs_buf->fd = -1;
+    
+    int lfs_run;
+    int lfs_blockPointer;
+    lfs_blockPointer = lfs_getBlockRun(lfs_inode, lfs_index, (lfs_blockOffset + (size - done) + BLOCK_SIZE - 1) / BLOCK_SIZE, &lfs_run);
+    if(lfs_blockPointer == -1) {
+      //hole in the file, reads as zeros
+      lfs_buf->mem = calloc(1, length);
+    } else {
+      length = (size_t) lfs_run * BLOCK_SIZE - lfs_blockOffset;
+      if(length > size - done) {
+        length = size - done;
+      }
+      
+      //a run already in the image file is spliced from it, its segments stay pinned until libfuse sent the reply
+      //one only in the private disk in memory is copied, libfuse frees memory buffers
+      int lfs_written = 0;
+      if(!lfs_config.direct) {
+        pthread_mutex_lock(&lfs_logLock);
+        lfs_written = lfs_onHarddisk(lfs_blockPointer, lfs_run) && lfs_pinSegment(SEGMENT_OF(lfs_blockPointer)) && lfs_pinSegment(SEGMENT_OF(lfs_blockPointer + lfs_run - 1));
+        pthread_mutex_unlock(&lfs_logLock);
+      }
+      if(lfs_written) {
+        lfs_buf->flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK | FUSE_BUF_FD_RETRY;
+        lfs_buf->fd = lfs_harddisk;
+        lfs_buf->pos = (off_t) lfs_blockPointer * BLOCK_SIZE + lfs_blockOffset;
+      } else {
+        lfs_buf->mem = malloc(length);
+        memcpy(lfs_buf->mem, lfs_disk_in_memory + (lfs_blockPointer * BLOCK_SIZE) + lfs_blockOffset, length);
+      }
+    }
+    lfs_buf->size = length;
+    lfs_bufv->count++;
+    
+    done += length;
+  }
+  pthread_rwlock_unlock(&lfs_file->lock);
+  
+  lfs_putOpenFile(lfs_file, fi);
+  
+  *bufp = lfs_bufv;
+  return 0;
+}
+
+//WRITE METHOD
+
+int lfs_write(const char * path, const char * buf, size_t size, off_t offset, struct fuse_file_info * fi) {
+  printf("write method called\n");
+  
+  //a plain buffer is a vector of one memory buffer
+  struct fuse_bufvec lfs_source = FUSE_BUFVEC_INIT(size);
+  lfs_source.buf[0].mem = (void *) buf;
+  
+  return lfs_write_buf(path, &lfs_source, offset, fi);
+}
+
+//WRITE BUF METHOD
+
+int lfs_write_buf(const char *path, struct fuse_bufvec *buf, off_t offset, struct fuse_file_info *fi) {
+  size_t done;
+  printf("write_buf method called\n");
+  
+  //get the open file
+  lfs_openFile *lfs_file;
+  lfs_file = lfs_getOpenFile(path, fi);
+  if(lfs_file == NULL) {
+    return -ENOENT;
+  }
+  
+  inode *lfs_inode;
+  lfs_inode = &lfs_file->inode;
+  pthread_rwlock_wrlock(&lfs_file->lock);
+  
+  //a small file keeps its data in the inode, one that outgrows it moves the data to its first block
+  size_t size = fuse_buf_size(buf);
+  int res = -EFBIG;
+  done = 0;
+  if((lfs_inode->flags & INODE_INLINE) && offset + size > INLINE_SIZE) {
+    res = lfs_expandInline(lfs_file);
+    if(res != 0) {
+      pthread_rwlock_unlock(&lfs_file->lock);
+      lfs_putOpenFile(lfs_file, fi);
+      
+      return res;
+    }
+  }
+  if(lfs_inode->flags & INODE_INLINE) {
+    struct fuse_bufvec lfs_target = FUSE_BUFVEC_INIT(size);
+    lfs_target.buf[0].mem = lfs_inode->inlineData + offset;
+    ssize_t lfs_copied;
+    lfs_copied = fuse_buf_copy(&lfs_target, buf, 0);
+    if(lfs_copied < 0) {
+      pthread_rwlock_unlock(&lfs_file->lock);
+      lfs_putOpenFile(lfs_file, fi);
+      
+      return lfs_copied;
+    }
+    done = lfs_copied;
+    size = done;
+  }
+  
+  //buffer used to build each partial block before it is appended to the log
+  char *lfs_blockData;
+  lfs_blockData = malloc(BLOCK_SIZE);
+  
+  while(done < size) {
+    int lfs_index = (offset + done) / BLOCK_SIZE;
+    int lfs_blockOffset = (offset + done) % BLOCK_SIZE;
+    size_t length = BLOCK_SIZE - lfs_blockOffset;
+    if(length > size - done) {
+      length = size - done;
+    }
+    
+    //file is full
+    if(lfs_index >= MAX_BLOCKS) {
+      res = -EFBIG;
+      break;
+    }
+    
+    //a whole block already in memory is appended from the request itself
+    char *lfs_data;
+    struct fuse_buf *lfs_piece;
+    lfs_piece = &buf->buf[buf->idx];
+    if(length == BLOCK_SIZE && !(lfs_piece->flags & FUSE_BUF_IS_FD) && lfs_piece->size - buf->off >= length) {
+      lfs_data = (char *) lfs_piece->mem + buf->off;
+    } else {
+      //anything else is copied into the block, a spliced pipe only once
+      lfs_data = lfs_blockData;
+      struct fuse_bufvec lfs_target = FUSE_BUFVEC_INIT(length);
+      lfs_target.buf[0].mem = lfs_blockData + lfs_blockOffset;
+      ssize_t lfs_copied;
+      lfs_copied = fuse_buf_copy(&lfs_target, buf, 0);
+      if(lfs_copied != (ssize_t) length) {
+        res = lfs_copied < 0 ? lfs_copied : -EIO;
+        break;
+      }
+      lfs_piece = NULL;
+    }
+    
+    //a block appended since the last snapshot of the inode map is still only in memory, it takes the bytes in place
+    int lfs_current;
+    lfs_current = lfs_getBlockPointer(lfs_inode, lfs_index);
+    int lfs_inPlace;
+    lfs_inPlace = lfs_current != -1 && lfs_updateUnwritten(lfs_current, lfs_blockOffset, lfs_data + lfs_blockOffset, length);
+    
+    //otherwise append the new version of the block to the log, waiting for the cleaner while it is full
+    res = 0;
+    while(!lfs_inPlace) {
+      //a partially overwritten block keeps the rest of its current content
+      if(length < BLOCK_SIZE) {
+        int lfs_blockPointer;
+        lfs_blockPointer = lfs_getBlockPointer(lfs_inode, lfs_index);
+        
+        if(lfs_blockPointer == -1) {
+          memset(lfs_blockData, 0, lfs_blockOffset);
+          memset(lfs_blockData + lfs_blockOffset + length, 0, BLOCK_SIZE - lfs_blockOffset - length);
+        } else {
+          char *lfs_old;
+          lfs_old = lfs_disk_in_memory + (lfs_blockPointer * BLOCK_SIZE);
+          memcpy(lfs_blockData, lfs_old, lfs_blockOffset);
+          memcpy(lfs_blockData + lfs_blockOffset + length, lfs_old + lfs_blockOffset + length, BLOCK_SIZE - lfs_blockOffset - length);
+        }
+      }
+      
+      int lfs_blockPointer;
+      lfs_blockPointer = lfs_insertData(lfs_data, BLOCK_SIZE, lfs_inode->ID, lfs_inode->version, SUMMARY_DATA, lfs_index);
+      if(lfs_blockPointer == -1) {
+        res = -ENOSPC;
+      } else {
+        res = lfs_setBlockPointer(lfs_inode, lfs_index, lfs_blockPointer);
+        if(res != 0) {
+          lfs_freeBlock(lfs_blockPointer);
+        }
+      }
+      if(res != -ENOSPC) {
+        break;
+      }
+      
+      //the log is full, wait for the cleaner without holding the file and redo the block
+      pthread_rwlock_unlock(&lfs_file->lock);
+      int lfs_room = lfs_throttle();
+      pthread_rwlock_wrlock(&lfs_file->lock);
+      if(!lfs_room) {
+        break;
+      }
+    }
+    if(res != 0) {
+      break;
+    }
+    
+    //a block taken from the request still has to be stepped over
+    if(lfs_piece != NULL) {
+      buf->off += length;
+      if(buf->off == lfs_piece->size) {
+        buf->idx++;
+        buf->off = 0;
+      }
+    }
+    
+    done += length;
+  }
+  free(lfs_blockData);
+  
+  if(done == 0 && size > 0) {
+    pthread_rwlock_unlock(&lfs_file->lock);
+    lfs_putOpenFile(lfs_file, fi);
+    
+    return res;
+  }
+  
+  //the file only grows if the write went past its end
+  if(offset + done > lfs_inode->size) {
+    lfs_inode->size = offset + done;
+  }
+  lfs_inode->modify = time(NULL);
+  
+  //the inode itself is logged on flush or release
+  lfs_file->dirty = 1;
+  pthread_rwlock_unlock(&lfs_file->lock);
+  lfs_putOpenFile(lfs_file, fi);
+  
+  return done;
+}
+
+
+//FLUSH METHOD
+
+int lfs_flush(const char *path, struct fuse_file_info *fi) {
+	printf("flush method called\n");
+	
+	lfs_openFile *lfs_file;
+	lfs_file = (lfs_openFile *) (uintptr_t) fi->fh;
+	
+	//log the pinned inode if it changed
+	int res;
+	pthread_rwlock_wrlock(&lfs_file->lock);
+	res = lfs_flushInode(lfs_file);
+	pthread_rwlock_unlock(&lfs_file->lock);
+	
+	return res;
+}
+
+//FSYNC METHOD
+
+int lfs_fsync(const char *path, int datasync, struct fuse_file_info *fi) {
+	printf("fsync method called\n");
+  
+  lfs_openFile *lfs_file;
+  lfs_file = lfs_getOpenFile(path, fi);
+  if(lfs_file == NULL) {
+    return -ENOENT;
+  }
+  
+  //the inode holds the block pointers, so it is logged for a datasync too
+  int res;
+  do {
+    pthread_rwlock_wrlock(&lfs_file->lock);
+    res = lfs_flushInode(lfs_file);
+    pthread_rwlock_unlock(&lfs_file->lock);
+  } while(res != 0 && lfs_throttle());
+  lfs_putOpenFile(lfs_file, fi);
+  if(res != 0) {
+    return res;
+  }
+  
+  //the partial segments go to the harddisk and their header names the inode map, shared with concurrent callers
+  return lfs_commit();
+}
+
+//FSYNC DIRECTORY METHOD
+
+int lfs_fsyncdir(const char *path, int datasync, struct fuse_file_info *fi) {
+	printf("fsyncdir method called\n");
+  
+  //directories are not opened, the path pins the inode and its entry blocks go out like file data
+  return lfs_fsync(path, datasync, fi);
+}
+
+//RELEASE METHOD
+
+int lfs_release(const char *path, struct fuse_file_info *fi) {
+	printf("release method called\n");
+  
+  //drop the handle, the last one logs the inode and unpins it
+  lfs_unpinInode((lfs_openFile *) (uintptr_t) fi->fh);
+  fi->fh = 0;
+	
+	return 0;
+}
+
+//PIN INODE METHOD
+
+lfs_openFile *lfs_pinInode(int ID) {
+  printf("pinInode method called\n");
+  
+  //the inode is already pinned
+  pthread_mutex_lock(&lfs_openLock);
+  if(lfs_openFiles[ID] != NULL) {
+    if(lfs_openFiles[ID]->count++ == 0) {
+      lfs_idleInodes--;
+    }
+    
+    lfs_openFile *lfs_file;
+    lfs_file = lfs_openFiles[ID];
+    pthread_mutex_unlock(&lfs_openLock);
+    
+    return lfs_file;
+  }
+  
+  //copy the inode out of the disk in memory once
+  lfs_openFile *lfs_file;
+  lfs_file = malloc(sizeof(lfs_openFile));
+  lfs_file->ID = ID;
+  lfs_file->count = 1;
+  lfs_file->dirty = 0;
+  lfs_file->unlinked = 0;
+  lfs_file->next = NULL;
+  pthread_rwlock_init(&lfs_file->lock, NULL);
+  pthread_rwlock_rdlock(&lfs_mapLock);
+  memcpy(&lfs_file->inode, lfs_findInode(lfs_inodeArray[ID], ID), sizeof(inode));
+  pthread_rwlock_unlock(&lfs_mapLock);
+  
+  lfs_openFiles[ID] = lfs_file;
+  pthread_mutex_unlock(&lfs_openLock);
+  
+  return lfs_file;
+}
+
+//UNPIN INODE METHOD
+
+void lfs_unpinInode(lfs_openFile *lfs_file) {
+  printf("unpinInode method called\n");
+  
+  pthread_mutex_lock(&lfs_openLock);
+  lfs_file->count--;
+  while(lfs_file->count == 0 && lfs_file->dirty && !lfs_file->unlinked) {
+    //last holder, a changed inode stays in the table so further changes are logged with it by the next write back
+    if(lfs_idleInodes < DIRTY_INODES) {
+      lfs_idleInodes++;
+      pthread_mutex_unlock(&lfs_openLock);
+      
+      return;
+    }
+    
+    //too many are waiting, log the inode without the open lock since the log can wait for the flusher
+    //the file keeps one pin meanwhile so a new holder finds it in the table instead of the old logged inode
+    lfs_file->count++;
+    pthread_mutex_unlock(&lfs_openLock);
+    int res;
+    pthread_rwlock_wrlock(&lfs_file->lock);
+    res = lfs_flushInode(lfs_file);
+    pthread_rwlock_unlock(&lfs_file->lock);
+    pthread_mutex_lock(&lfs_openLock);
+    lfs_file->count--;
+    if(res != 0 && lfs_file->count == 0) {
+      //the log is full, the inode stays in the table and dirty until the cleaner made room
+      lfs_idleInodes++;
+      pthread_mutex_unlock(&lfs_openLock);
+      
+      return;
+    }
+  }
+  if(lfs_file->count > 0) {
+    pthread_mutex_unlock(&lfs_openLock);
+    
+    return;
+  }
+  
+  //nobody holds it and nothing is left to log, forget it before anyone can pin it again
+  if(lfs_openFiles[lfs_file->ID] == lfs_file) {
+    lfs_openFiles[lfs_file->ID] = NULL;
+  }
+  
+  //the blocks of a removed file were kept for its last holder
+  if(lfs_file->unlinked) {
+    lfs_openFile **lfs_link;
+    lfs_link = &lfs_unlinkedFiles;
+    while(*lfs_link != lfs_file) {
+      lfs_link = &(*lfs_link)->next;
+    }
+    *lfs_link = lfs_file->next;
+    lfs_forEachBlock(&lfs_file->inode, lfs_freeBlock);
+  }
+  pthread_mutex_unlock(&lfs_openLock);
+  
+  pthread_rwlock_destroy(&lfs_file->lock);
+  free(lfs_file);
+}
+
+//FLUSH INODE METHOD
+
+int lfs_flushInode(lfs_openFile *lfs_file) {
+  printf("flushInode method called\n");
+  
+  //a removed file must not be brought back by its last writer
+  if(lfs_file->dirty && !lfs_file->unlinked) {
+    if(lfs_writeInode(&lfs_file->inode, lfs_file) != 0) {
+      //stays dirty, the next flush tries again
+      return -ENOSPC;
+    }
+  }
+  lfs_file->dirty = 0;
+  
+  return 0;
+}
+
+//WRITE INODE METHOD
+
+int lfs_writeInode(inode *lfs_inode, lfs_openFile *lfs_file) {
+  //log the inode and point the map to it, unless the open file it belongs to was removed meanwhile
+  int lfs_ID = lfs_inode->ID;
+  pthread_mutex_lock(&lfs_logLock);
+  
+  //the inode block of the log head takes inodes until it is full or on its way to the harddisk
+  int h;
+  h = lfs_pickHead(SUMMARY_INODE);
+  int lfs_block = lfs_inodeBlocks[h];
+  int lfs_slot = -1;
+  if(lfs_block != -1 && lfs_isUnwritten(lfs_block)) {
+    lfs_slot = lfs_findSlot(lfs_block, lfs_ID);
+  }
+  if(lfs_slot == -1) {
+    //start a new inode block, the summary names no owner since every slot has its own
+    char *lfs_data;
+    lfs_data = malloc(BLOCK_SIZE);
+    memset(lfs_data, 0, BLOCK_SIZE);
+    int k;
+    for(k=1; k<INODES_PER_BLOCK; k++) {
+      ((inode *) lfs_data)[k].ID = -1;
+    }
+    memcpy(lfs_data, lfs_inode, sizeof(inode));
+    
+    //an inode of the table may take the reserve kept for it, a new one may not
+    lfs_writingBack = lfs_file != NULL;
+    lfs_block = lfs_appendBlock(lfs_data, BLOCK_SIZE, -1, 0, SUMMARY_INODE, 0);
+    lfs_writingBack = 0;
+    free(lfs_data);
+    if(lfs_block == -1) {
+      pthread_mutex_unlock(&lfs_logLock);
+      
+      return -ENOSPC;
+    }
+    
+    //only the filled slot counts for the segment
+    lfs_usage[SEGMENT_OF(lfs_block)].liveBytes -= BLOCK_SIZE - (int) sizeof(inode);
+    lfs_inodeBlocks[h] = lfs_block;
+  }
+  
+  //readers of the map never see a half written slot
+  int lfs_oldBlock = -1;
+  pthread_rwlock_wrlock(&lfs_mapLock);
+  if(lfs_file == NULL || !lfs_file->unlinked) {
+    if(lfs_slot != -1) {
+      memcpy(lfs_disk_in_memory + (lfs_block * BLOCK_SIZE) + lfs_slot * sizeof(inode), lfs_inode, sizeof(inode));
+      lfs_usage[SEGMENT_OF(lfs_block)].liveBytes += (int) sizeof(inode);
+    }
+    lfs_oldBlock = lfs_inodeArray[lfs_ID];
+    lfs_setInodeEntry(lfs_ID, lfs_block);
+  } else if(lfs_slot == -1) {
+    //the file was removed while the inode was appended
+    lfs_oldBlock = lfs_block;
+  }
+  pthread_rwlock_unlock(&lfs_mapLock);
+  if(lfs_oldBlock != -1) {
+    lfs_usage[SEGMENT_OF(lfs_oldBlock)].liveBytes -= (int) sizeof(inode);
+  }
+  pthread_mutex_unlock(&lfs_logLock);
+  
+  return 0;
+}
+
+//FIND INODE METHOD
+
+inode *lfs_findInode(int block, int ID) {
+  //the slot of the inode block holding the ID, the map only names blocks that hold it
+  inode *lfs_inodes;
+  lfs_inodes = (inode *)(lfs_disk_in_memory + (block * BLOCK_SIZE));
+  int k;
+  for(k=0; k<INODES_PER_BLOCK; k++) {
+    if(lfs_inodes[k].ID == ID) {
+      return &lfs_inodes[k];
+    }
+  }
+  
+  return NULL;
+}
+
+//FIND SLOT METHOD
+
+int lfs_findSlot(int block, int ID) {
+  //the caller holds the log lock, an older copy of the same inode is overwritten so an ID is never twice in a block
+  inode *lfs_inodes;
+  lfs_inodes = (inode *)(lfs_disk_in_memory + (block * BLOCK_SIZE));
+  int lfs_free = -1;
+  int k;
+  for(k=0; k<INODES_PER_BLOCK; k++) {
+    if(lfs_inodes[k].ID == ID) {
+      return k;
+    }
+    if(lfs_inodes[k].ID == -1 && lfs_free == -1) {
+      lfs_free = k;
+    }
+  }
+  
+  return lfs_free;
+}
+
+//LIVE INODES METHOD
+
+int lfs_liveInodes(int block) {
+  //slots of an inode block the map still names
+  inode *lfs_inodes;
+  lfs_inodes = (inode *)(lfs_disk_in_memory + (block * BLOCK_SIZE));
+  int lfs_live = 0;
+  int k;
+  for(k=0; k<INODES_PER_BLOCK; k++) {
+    int lfs_ID = lfs_inodes[k].ID;
+    if(lfs_ID >= 0 && lfs_ID < NUMBER_OF_INODES && lfs_inodeArray[lfs_ID] == block) {
+      lfs_live++;
+    }
+  }
+  
+  return lfs_live;
+}
+
+//FREE INODE METHOD
+
+void lfs_freeInode(int block) {
+  //a removed inode gives back its slot, the block goes with its last one
+  if(block == -1) {
+    return;
+  }
+  pthread_mutex_lock(&lfs_logLock);
+  lfs_usage[SEGMENT_OF(block)].liveBytes -= (int) sizeof(inode);
+  pthread_mutex_unlock(&lfs_logLock);
+}
+
+//EXPAND INLINE METHOD
+
+int lfs_expandInline(lfs_openFile *lfs_file) {
+  //the caller holds the file for writing, the inline data becomes the first block of the file
+  inode *lfs_inode;
+  lfs_inode = &lfs_file->inode;
+  int res = 0;
+  while(lfs_inode->flags & INODE_INLINE) {
+    int lfs_block = -1;
+    res = 0;
+    if(lfs_inode->size > 0) {
+      lfs_block = lfs_insertData(lfs_inode->inlineData, lfs_inode->size, lfs_inode->ID, lfs_inode->version, SUMMARY_DATA, 0);
+      res = lfs_block == -1 ? -ENOSPC : lfs_setBlockPointer(lfs_inode, 0, lfs_block);
+      if(res != 0) {
+        lfs_freeBlock(lfs_block);
+      }
+    }
+    if(res == 0) {
+      lfs_inode->flags &= ~INODE_INLINE;
+      memset(lfs_inode->inlineData, 0, INLINE_SIZE);
+      lfs_file->dirty = 1;
+      break;
+    }
+    if(res != -ENOSPC) {
+      break;
+    }
+    
+    //the log is full, wait for the cleaner without holding the file, someone else may expand it meanwhile
+    pthread_rwlock_unlock(&lfs_file->lock);
+    int lfs_room = lfs_throttle();
+    pthread_rwlock_wrlock(&lfs_file->lock);
+    if(!lfs_room) {
+      break;
+    }
+    res = 0;
+  }
+  
+  return res;
+}
+
+//GET OPEN FILE METHOD
+
+lfs_openFile *lfs_getOpenFile(const char *path, struct fuse_file_info *fi) {
+  //the handle from open already holds the pinned inode
+  if(fi != NULL && fi->fh != 0) {
+    return (lfs_openFile *) (uintptr_t) fi->fh;
+  }
+  
+  //no handle, resolve the path and pin the inode for this call only
+  int lfs_inodeID;
+  pthread_rwlock_rdlock(&lfs_namespaceLock);
+  lfs_inodeID = lfs_findInodeID(path);
+  if(lfs_inodeID == -1) {
+    pthread_rwlock_unlock(&lfs_namespaceLock);
+    
+    return NULL;
+  }
+  
+  lfs_openFile *lfs_file;
+  lfs_file = lfs_pinInode(lfs_inodeID);
+  pthread_rwlock_unlock(&lfs_namespaceLock);
+  
+  return lfs_file;
+}
+
+//PUT OPEN FILE METHOD
+
+void lfs_putOpenFile(lfs_openFile *lfs_file, struct fuse_file_info *fi) {
+  //only unpin what lfs_getOpenFile pinned for a single call
+  if(fi == NULL || fi->fh == 0) {
+    lfs_unpinInode(lfs_file);
+  }
+}
+
+//GET INODE METHOD
+
+inode *lfs_getInode(int ID, inode *lfs_inode) {
+  //an open file's pinned copy is newer than the logged one, NULL if the map no longer names the ID
+  if(ID < 0 || ID >= NUMBER_OF_INODES) {
+    return NULL;
+  }
+  pthread_mutex_lock(&lfs_openLock);
+  lfs_openFile *lfs_file;
+  lfs_file = lfs_openFiles[ID];
+  if(lfs_file == NULL) {
+    inode *lfs_logged = NULL;
+    pthread_rwlock_rdlock(&lfs_mapLock);
+    if(lfs_inodeArray[ID] != -1) {
+      lfs_logged = lfs_findInode(lfs_inodeArray[ID], ID);
+    }
+    if(lfs_logged != NULL) {
+      memcpy(lfs_inode, lfs_logged, sizeof(inode));
+    }
+    pthread_rwlock_unlock(&lfs_mapLock);
+    pthread_mutex_unlock(&lfs_openLock);
+    
+    return lfs_logged != NULL ? lfs_inode : NULL;
+  }
+  
+  //hold the open file so it stays while its writer finishes
+  if(lfs_file->count++ == 0) {
+    lfs_idleInodes--;
+  }
+  pthread_mutex_unlock(&lfs_openLock);
+  
+  pthread_rwlock_rdlock(&lfs_file->lock);
+  memcpy(lfs_inode, &lfs_file->inode, sizeof(inode));
+  pthread_rwlock_unlock(&lfs_file->lock);
+  
+  lfs_unpinInode(lfs_file);
+  
+  return lfs_inode;
+}
+
+//GET BLOCK POINTER METHOD
+
+int lfs_getBlockPointer(inode *lfs_inode, int index) {
+  //a file mapped by extents looks the block up in its extent list
+  if(lfs_inode->flags & INODE_EXTENTS) {
+    if(lfs_inode->extentPointer == -1) {
+      return -1;
+    }
+    
+    lfs_extent *lfs_extents;
+    lfs_extents = (lfs_extent *)(lfs_disk_in_memory + (lfs_inode->extentPointer * BLOCK_SIZE));
+    
+    int e;
+    e = lfs_findExtent(lfs_extents, lfs_inode->extentCount, index);
+    if(e == -1 || index >= lfs_extents[e].start + lfs_extents[e].length) {
+      return -1;
+    }
+    return lfs_extents[e].block + (index - lfs_extents[e].start);
+  }
+  
+  //the first blocks of the file are held by the datapointers
+  if(index < NUMBER_OF_DATAPOINTERS) {
+    return lfs_inode->datapointer[index];
+  }
+  index -= NUMBER_OF_DATAPOINTERS;
+  
+  //pick the indirect level that holds the index
+  int lfs_pointer;
+  int lfs_depth;
+  if(index < NUMBER_OF_INDIRECTPOINTERS) {
+    lfs_pointer = lfs_inode->indirectDataPointer;
+    lfs_depth = 1;
+  } else if((index -= NUMBER_OF_INDIRECTPOINTERS) < NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS) {
+    lfs_pointer = lfs_inode->doubleIndirectDataPointer;
+    lfs_depth = 2;
+  } else if((index -= NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS) < NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS) {
+    lfs_pointer = lfs_inode->tripleIndirectDataPointer;
+    lfs_depth = 3;
+  } else {
+    return -1;
+  }
+  
+  //walk down one indirect block per level
+  int lfs_span = 1;
+  int d;
+  for(d=1; d<lfs_depth; d++) {
+    lfs_span *= NUMBER_OF_INDIRECTPOINTERS;
+  }
+  while(lfs_depth > 0 && lfs_pointer != -1) {
+    lfs_pointer = ((int *)(lfs_disk_in_memory + (lfs_pointer * BLOCK_SIZE)))[index / lfs_span];
+    index %= lfs_span;
+    lfs_span /= NUMBER_OF_INDIRECTPOINTERS;
+    lfs_depth--;
+  }
+  
+  return lfs_pointer;
+}
+
+//SET BLOCK POINTER METHOD
+
+int lfs_setBlockPointer(inode *lfs_inode, int index, int value) {
+  //the block a file or directory replaces is garbage once the new pointer is set
+  int lfs_old;
+  lfs_old = lfs_getBlockPointer(lfs_inode, index);
+  
+  //a file mapped by extents updates its extent list
+  int res = -EFBIG;
+  if(lfs_inode->flags & INODE_EXTENTS) {
+    res = lfs_setExtent(lfs_inode, index, value);
+    if(res == -1) {
+      //too fragmented for one extent block, fall back to the block map
+      res = lfs_convertToBlockMap(lfs_inode);
+      if(res != 0) {
+        //the extent list is unchanged, the caller keeps the block it wanted to set
+        return res;
+      }
+    }
+  }
+  
+  if(lfs_inode->flags & INODE_EXTENTS) {
+    //the extent list took the block, or failed for lack of space
+  } else if(index < NUMBER_OF_DATAPOINTERS) {
+    //the first blocks of the file are held by the datapointers
+    lfs_inode->datapointer[index] = value;
+    res = 0;
+  } else if(index - NUMBER_OF_DATAPOINTERS < NUMBER_OF_INDIRECTPOINTERS) {
+    //pick the indirect level that holds the index
+    res = lfs_setIndirectPointer(lfs_inode, index, &lfs_inode->indirectDataPointer, 1, index - NUMBER_OF_DATAPOINTERS, value);
+  } else if(index - NUMBER_OF_DATAPOINTERS - NUMBER_OF_INDIRECTPOINTERS < NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS) {
+    res = lfs_setIndirectPointer(lfs_inode, index, &lfs_inode->doubleIndirectDataPointer, 2, index - NUMBER_OF_DATAPOINTERS - NUMBER_OF_INDIRECTPOINTERS, value);
+  } else if(index - NUMBER_OF_DATAPOINTERS - NUMBER_OF_INDIRECTPOINTERS - NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS < NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS) {
+    res = lfs_setIndirectPointer(lfs_inode, index, &lfs_inode->tripleIndirectDataPointer, 3, index - NUMBER_OF_DATAPOINTERS - NUMBER_OF_INDIRECTPOINTERS - NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS, value);
+  }
+  
+  if(res == 0 && lfs_old != value) {
+    lfs_freeBlock(lfs_old);
+  }
+  return res;
+}
+
+//SET INDIRECT POINTER METHOD
+
+int lfs_setIndirectPointer(inode *lfs_inode, int fileIndex, int *pointer, int depth, int index, int value) {
+  int lfs_span = 1;
+  int d;
+  for(d=1; d<depth; d++) {
+    lfs_span *= NUMBER_OF_INDIRECTPOINTERS;
+  }
+  int lfs_slot = index / lfs_span;
+  
+  //the lower levels are updated first, they may move to a new block
+  int lfs_value = value;
+  if(depth > 1) {
+    lfs_value = -1;
+    if(*pointer != -1) {
+      lfs_value = ((int *)(lfs_disk_in_memory + (*pointer * BLOCK_SIZE)))[lfs_slot];
+    }
+    int res;
+    res = lfs_setIndirectPointer(lfs_inode, fileIndex, &lfs_value, depth-1, index % lfs_span, value);
+    if(res != 0) {
+      return res;
+    }
+  }
+  
+  //an indirect block that has not reached the harddisk yet is only referenced by this inode, update it in place
+  if(*pointer != -1 && lfs_updateUnwritten(*pointer, lfs_slot * sizeof(int), &lfs_value, sizeof(int))) {
+    return 0;
+  }
+  
+  //otherwise append a new copy of the indirect block to the log
+  int *lfs_indirectPointersArray;
+  lfs_indirectPointersArray = malloc(NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
+  if(*pointer == -1) {
+    int l;
+    for(l=0; l<NUMBER_OF_INDIRECTPOINTERS; l++) {
+      lfs_indirectPointersArray[l] = -1;
+    }
+  } else {
+    memcpy(lfs_indirectPointersArray, lfs_disk_in_memory + (*pointer * BLOCK_SIZE), NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
+  }
+  lfs_indirectPointersArray[lfs_slot] = lfs_value;
+  
+  int lfs_newPointer;
+  lfs_newPointer = lfs_insertData((char *) lfs_indirectPointersArray, NUMBER_OF_INDIRECTPOINTERS * sizeof(int), lfs_inode->ID, lfs_inode->version, SUMMARY_INDIRECT + depth - 1, fileIndex);
+  free(lfs_indirectPointersArray);
+  if(lfs_newPointer == -1) {
+    return -ENOSPC;
+  }
+  
+  //the old copy is garbage now
+  lfs_freeBlock(*pointer);
+  *pointer = lfs_newPointer;
+  
+  return 0;
+}
+
+//FIND TREE METHOD
+
+int *lfs_findTree(inode *lfs_inode, int *index, int *depth) {
+  //pick the indirect pointer whose tree maps a logical block, the index becomes relative to that tree
+  *index -= NUMBER_OF_DATAPOINTERS;
+  if(*index < 0) {
+    return NULL;
+  }
+  if(*index < NUMBER_OF_INDIRECTPOINTERS) {
+    *depth = 1;
+    return &lfs_inode->indirectDataPointer;
+  }
+  *index -= NUMBER_OF_INDIRECTPOINTERS;
+  if(*index < NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS) {
+    *depth = 2;
+    return &lfs_inode->doubleIndirectDataPointer;
+  }
+  *index -= NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS;
+  if(*index < NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS * NUMBER_OF_INDIRECTPOINTERS) {
+    *depth = 3;
+    return &lfs_inode->tripleIndirectDataPointer;
+  }
+  return NULL;
+}
+
+//GET INDIRECT BLOCK METHOD
+
+int lfs_getIndirectBlock(inode *lfs_inode, int index, int height) {
+  //the indirect block at the given height on the way to a logical block
+  int lfs_depth;
+  int *lfs_root;
+  lfs_root = lfs_findTree(lfs_inode, &index, &lfs_depth);
+  if(lfs_root == NULL || height < 1 || height > lfs_depth) {
+    return -1;
+  }
+  
+  int lfs_pointer = *lfs_root;
+  int lfs_level;
+  for(lfs_level = lfs_depth; lfs_level > height && lfs_pointer != -1; lfs_level--) {
+    int lfs_span = 1;
+    int d;
+    for(d=1; d<lfs_level; d++) {
+      lfs_span *= NUMBER_OF_INDIRECTPOINTERS;
+    }
+    lfs_pointer = ((int *)(lfs_disk_in_memory + (lfs_pointer * BLOCK_SIZE)))[(index / lfs_span) % NUMBER_OF_INDIRECTPOINTERS];
+  }
+  return lfs_pointer;
+}
+
+//SET INDIRECT CHILD METHOD
+
+int lfs_setIndirectChild(inode *lfs_inode, int index, int height, int value) {
+  //point the block one level up, or the inode at the top, to a moved indirect block
+  int lfs_index = index;
+  int lfs_depth;
+  int *lfs_root;
+  lfs_root = lfs_findTree(lfs_inode, &lfs_index, &lfs_depth);
+  if(lfs_root == NULL || height > lfs_depth) {
+    return -1;
+  }
+  if(height == lfs_depth) {
+    *lfs_root = value;
+    
+    return 0;
+  }
+  
+  int lfs_parent;
+  lfs_parent = lfs_getIndirectBlock(lfs_inode, index, height + 1);
+  int lfs_span = 1;
+  int d;
+  for(d=0; d<height; d++) {
+    lfs_span *= NUMBER_OF_INDIRECTPOINTERS;
+  }
+  int lfs_slot = (lfs_index / lfs_span) % NUMBER_OF_INDIRECTPOINTERS;
+  
+  //a parent in the log head takes the pointer in place, any other one moves as well
+  if(lfs_updateUnwritten(lfs_parent, lfs_slot * sizeof(int), &value, sizeof(int))) {
+    return 0;
+  }
+  
+  int *lfs_indirectPointersArray;
+  lfs_indirectPointersArray = malloc(NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
+  memcpy(lfs_indirectPointersArray, lfs_disk_in_memory + (lfs_parent * BLOCK_SIZE), NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
+  lfs_indirectPointersArray[lfs_slot] = value;
+  
+  int lfs_newPointer;
+  lfs_newPointer = lfs_insertData((char *) lfs_indirectPointersArray, NUMBER_OF_INDIRECTPOINTERS * sizeof(int), lfs_inode->ID, lfs_inode->version, SUMMARY_INDIRECT + height, index);
+  free(lfs_indirectPointersArray);
+  if(lfs_newPointer == -1) {
+    return -ENOSPC;
+  }
+  
+  int res;
+  res = lfs_setIndirectChild(lfs_inode, index, height + 1, lfs_newPointer);
+  if(res != 0) {
+    lfs_freeBlock(lfs_newPointer);
+    
+    return res;
+  }
+  lfs_freeBlock(lfs_parent);
+  
+  return 0;
+}
+
+//IS UNWRITTEN METHOD
+
+int lfs_isUnwritten(int block) {
+  //blocks of the log head segments stay in memory until the segment is full, the caller holds the log lock
+  int h;
+  h = lfs_isHead(SEGMENT_OF(block));
+  if(h == -1 || block >= lfs_heads[h].block || lfs_heads[h].block == SEGMENT_START(lfs_heads[h].segment) + BLOCKS_PER_SEGMENT) {
+    return 0;
+  }
+  
+  //a block from before the last snapshot of the inode map can be named by a header or checkpoint, it must keep its content
+  return lfs_snapshotHeads[h].segment != lfs_heads[h].segment || block >= lfs_snapshotHeads[h].block;
+}
+
+//UPDATE UNWRITTEN METHOD
+
+int lfs_updateUnwritten(int block, int offset, const void *data, int size) {
+  //check and update under the log lock, so the segment cannot be handed to the flusher in between
+  int res;
+  pthread_mutex_lock(&lfs_logLock);
+  res = lfs_isUnwritten(block);
+  if(res) {
+    memcpy(lfs_disk_in_memory + (block * BLOCK_SIZE) + offset, data, size);
+  }
+  pthread_mutex_unlock(&lfs_logLock);
+  
+  return res;
+}
+
+//GET BLOCK RUN METHOD
+
+int lfs_getBlockRun(inode *lfs_inode, int index, int max, int *run) {
+  int lfs_blockPointer;
+  lfs_blockPointer = lfs_getBlockPointer(lfs_inode, index);
+  *run = 1;
+  if(lfs_blockPointer == -1) {
+    return -1;
+  }
+  
+  if(lfs_inode->flags & INODE_EXTENTS) {
+    //the rest of the extent is contiguous by definition
+    lfs_extent *lfs_extents;
+    lfs_extents = (lfs_extent *)(lfs_disk_in_memory + (lfs_inode->extentPointer * BLOCK_SIZE));
+    
+    int e;
+    e = lfs_findExtent(lfs_extents, lfs_inode->extentCount, index);
+    *run = lfs_extents[e].start + lfs_extents[e].length - index;
+  } else {
+    //the block map has to be checked pointer by pointer
+    while(*run < max && lfs_getBlockPointer(lfs_inode, index + *run) == lfs_blockPointer + *run) {
+      (*run)++;
+    }
+  }
+  
+  if(*run > max) {
+    *run = max;
+  }
+  return lfs_blockPointer;
+}
+
+//FIND EXTENT METHOD
+
+int lfs_findExtent(lfs_extent *lfs_extents, int count, int index) {
+  //binary search for the last extent starting at or before the index
+  int lfs_low = 0;
+  int lfs_high = count - 1;
+  int res = -1;
+  while(lfs_low <= lfs_high) {
+    int lfs_middle = (lfs_low + lfs_high) / 2;
+    if(lfs_extents[lfs_middle].start <= index) {
+      res = lfs_middle;
+      lfs_low = lfs_middle + 1;
+    } else {
+      lfs_high = lfs_middle - 1;
+    }
+  }
+  return res;
+}
+
+//SET EXTENT METHOD
+
+int lfs_setExtent(inode *lfs_inode, int index, int value) {
+  //work on a copy with room for a split and an insert
+  lfs_extent *lfs_extents;
+  lfs_extents = malloc((lfs_inode->extentCount + 2) * sizeof(lfs_extent));
+  int lfs_count = lfs_inode->extentCount;
+  if(lfs_inode->extentPointer != -1) {
+    memcpy(lfs_extents, lfs_disk_in_memory + (lfs_inode->extentPointer * BLOCK_SIZE), lfs_count * sizeof(lfs_extent));
+  }
+  
+  int e;
+  e = lfs_findExtent(lfs_extents, lfs_count, index);
+  
+  //cut the index out of the extent that covers it
+  if(e != -1 && index < lfs_extents[e].start + lfs_extents[e].length) {
+    lfs_extent lfs_tail;
+    lfs_tail.start = index + 1;
+    lfs_tail.block = lfs_extents[e].block + (index + 1 - lfs_extents[e].start);
+    lfs_tail.length = lfs_extents[e].start + lfs_extents[e].length - (index + 1);
+    lfs_extents[e].length = index - lfs_extents[e].start;
+    
+    if(lfs_tail.length > 0) {
+      memmove(&lfs_extents[e+2], &lfs_extents[e+1], (lfs_count - e - 1) * sizeof(lfs_extent));
+      lfs_extents[e+1] = lfs_tail;
+      lfs_count++;
+    }
+    if(lfs_extents[e].length == 0) {
+      memmove(&lfs_extents[e], &lfs_extents[e+1], (lfs_count - e - 1) * sizeof(lfs_extent));
+      lfs_count--;
+      e--;
+    }
+  }
+  
+  if(value != -1) {
+    //insert a one block extent behind e
+    memmove(&lfs_extents[e+2], &lfs_extents[e+1], (lfs_count - e - 1) * sizeof(lfs_extent));
+    lfs_extents[e+1].start = index;
+    lfs_extents[e+1].block = value;
+    lfs_extents[e+1].length = 1;
+    lfs_count++;
+    
+    //join it with the run before, which is what a sequential append does
+    if(e >= 0 && lfs_extents[e].start + lfs_extents[e].length == index && lfs_extents[e].block + lfs_extents[e].length == value) {
+      lfs_extents[e].length++;
+      memmove(&lfs_extents[e+1], &lfs_extents[e+2], (lfs_count - e - 2) * sizeof(lfs_extent));
+      lfs_count--;
+    } else {
+      e++;
+    }
+    
+    //join it with the run after
+    if(e + 1 < lfs_count && lfs_extents[e].start + lfs_extents[e].length == lfs_extents[e+1].start && lfs_extents[e].block + lfs_extents[e].length == lfs_extents[e+1].block) {
+      lfs_extents[e].length += lfs_extents[e+1].length;
+      memmove(&lfs_extents[e+1], &lfs_extents[e+2], (lfs_count - e - 2) * sizeof(lfs_extent));
+      lfs_count--;
+    }
+  }
+  
+  //nothing to store for a file without blocks
+  if(lfs_count == 0 && lfs_inode->extentPointer == -1) {
+    free(lfs_extents);
+    
+    return 0;
+  }
+  
+  //the caller switches to the block map if the list no longer fits
+  if(lfs_count > EXTENTS_PER_BLOCK) {
+    free(lfs_extents);
+    
+    return -1;
+  }
+  
+  //an extent block that has not reached the harddisk yet is updated in place
+  if(lfs_inode->extentPointer == -1 || !lfs_updateUnwritten(lfs_inode->extentPointer, 0, lfs_extents, lfs_count * sizeof(lfs_extent))) {
+    int lfs_newPointer;
+    lfs_newPointer = lfs_insertData((char *) lfs_extents, lfs_count * sizeof(lfs_extent), lfs_inode->ID, lfs_inode->version, SUMMARY_EXTENTS, 0);
+    if(lfs_newPointer == -1) {
+      free(lfs_extents);
+      
+      return -ENOSPC;
+    }
+    lfs_freeBlock(lfs_inode->extentPointer);
+    lfs_inode->extentPointer = lfs_newPointer;
+  }
+  lfs_inode->extentCount = lfs_count;
+  
+  free(lfs_extents);
+  
+  return 0;
+}
+
+//CONVERT TO BLOCK MAP METHOD
+
+int lfs_convertToBlockMap(inode *lfs_inode) {
+  printf("convertToBlockMap method called\n");
+  
+  //take the extents out, appending to the log may move the extent block
+  int lfs_count = lfs_inode->extentCount;
+  lfs_extent *lfs_extents;
+  lfs_extents = malloc(lfs_count * sizeof(lfs_extent) + 1);
+  if(lfs_inode->extentPointer != -1) {
+    memcpy(lfs_extents, lfs_disk_in_memory + (lfs_inode->extentPointer * BLOCK_SIZE), lfs_count * sizeof(lfs_extent));
+  }
+  
+  //build the block map in a copy, the union of the inode keeps the extents until every block is mapped
+  inode lfs_map;
+  memcpy(&lfs_map, lfs_inode, sizeof(inode));
+  lfs_map.flags &= ~INODE_EXTENTS;
+  int j;
+  for(j=0; j<NUMBER_OF_DATAPOINTERS; j++) {
+    lfs_map.datapointer[j] = -1;
+  }
+  lfs_map.indirectDataPointer = -1;
+  lfs_map.doubleIndirectDataPointer = -1;
+  lfs_map.tripleIndirectDataPointer = -1;
+  
+  //map every block of every run
+  int res = 0;
+  int e;
+  for(e=0; e<lfs_count && res == 0; e++) {
+    int k;
+    for(k=0; k<lfs_extents[e].length && res == 0; k++) {
+      res = lfs_setBlockPointer(&lfs_map, lfs_extents[e].start + k, lfs_extents[e].block + k);
+    }
+  }
+  free(lfs_extents);
+  if(res != 0) {
+    //the log is full, drop the indirect blocks written so far but not the data blocks they name
+    lfs_freeTree(lfs_map.indirectDataPointer, 1);
+    lfs_freeTree(lfs_map.doubleIndirectDataPointer, 2);
+    lfs_freeTree(lfs_map.tripleIndirectDataPointer, 3);
+    
+    return res;
+  }
+  
+  //the extent block is garbage now
+  lfs_freeBlock(lfs_inode->extentPointer);
+  memcpy(lfs_inode, &lfs_map, sizeof(inode));
+  
+  return 0;
+}
+
+//FREE TREE METHOD
+
+void lfs_freeTree(int pointer, int depth) {
+  //free the indirect blocks of a tree, the blocks on the lowest level still belong to the file
+  if(pointer == -1) {
+    return;
+  }
+  
+  if(depth > 1) {
+    int *lfs_indirectPointersArray;
+    lfs_indirectPointersArray = (int *)(lfs_disk_in_memory + (pointer * BLOCK_SIZE));
+    int l;
+    for(l=0; l<NUMBER_OF_INDIRECTPOINTERS; l++) {
+      lfs_freeTree(lfs_indirectPointersArray[l], depth-1);
+    }
+  }
+  lfs_freeBlock(pointer);
+}
+
+//FIND INODE ID METHOD
+
+int lfs_findInodeID(const char *path) {
+  int res = 0;
+  printf("findInodeID method called\n");
+  
+  //check if the given path is root
+  if(strcmp("/", path) == 0) {
+    //the root will always be at index 0
+    return 0;
+  }
+  
+  //lookups share the namespace lock, so the caches they fill need their own
+  pthread_mutex_lock(&lfs_cacheLock);
+  
+  //check the path cache, this includes paths known not to exist
+  if(lfs_lookupPath(path, &res)) {
+    pthread_mutex_unlock(&lfs_cacheLock);
+    
+    return res;
+  }
+  
+  //copy the path so it can be split into names
+  char *lfs_path;
+  lfs_path = malloc(strlen(path)+1);
+  memcpy(lfs_path, path, strlen(path)+1);
+  
+  //walk down from the root, one hash probe per name, the entry types say where it can go on
+  char *lfs_name;
+  char *lfs_save;
+  int lfs_type = 0;
+  lfs_name = strtok_r(lfs_path, "/", &lfs_save);
+  while(lfs_name != NULL && res != -1) {
+    if(lfs_type != 0) {
+      //only directories have children
+      res = -1;
+    } else {
+      res = lfs_lookupChild(res, lfs_name, &lfs_type);
+    }
+    lfs_name = strtok_r(NULL, "/", &lfs_save);
+  }
+  
+  lfs_addPath(path, res);
+  pthread_mutex_unlock(&lfs_cacheLock);
+  
+  free(lfs_path);
+  return res;
+}
+
+//HASH METHOD
+
+unsigned int lfs_hash(int parent, const char *name) {
+  //FNV-1a over the parent ID and at most MAX_LENGTH characters of the name
+  unsigned int hash = 2166136261u ^ (unsigned int) parent;
+  hash *= 16777619u;
+  
+  int i;
+  for(i=0; i<MAX_LENGTH && name[i] != '\0'; i++) {
+    hash ^= (unsigned char) name[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+//LOOKUP CHILD METHOD
+
+int lfs_lookupChild(int parent, const char *name, int *type) {
+  //load the directory the first time one of its children is looked up
+  if(!lfs_dirCached[parent]) {
+    lfs_cacheDirectory(parent);
+  }
+  
+  //the directory is fully cached, so a miss means there is no such child
+  lfs_dentry *lfs_entry;
+  lfs_entry = lfs_dentryTable[lfs_hash(parent, name) % DENTRY_BUCKETS];
+  while(lfs_entry != NULL) {
+    if(lfs_entry->parent == parent && !strncmp(lfs_entry->name, name, MAX_LENGTH)) {
+      *type = lfs_entry->type;
+      return lfs_entry->ID;
+    }
+    lfs_entry = lfs_entry->next;
+  }
+  return -1;
+}
+
+//CACHE DIRECTORY METHOD
+
+void lfs_cacheDirectory(int parent) {
+  printf("cacheDirectory method called\n");
+  
+  inode lfs_inode;
+  if(lfs_getInode(parent, &lfs_inode) == NULL) {
+    return;
+  }
+  
+  //the entries carry name and type, so no child inode is read
+  off_t lfs_offset = 0;
+  lfs_dirEntry *lfs_entry;
+  while((lfs_entry = lfs_nextEntry(&lfs_inode, &lfs_offset)) != NULL) {
+    char lfs_name[MAX_LENGTH+1];
+    memcpy(lfs_name, lfs_entry->name, lfs_entry->nameLength);
+    lfs_name[lfs_entry->nameLength] = '\0';
+    lfs_addDentry(parent, lfs_entry->ID, lfs_name, lfs_entry->type);
+  }
+  
+  lfs_dirCached[parent] = 1;
+}
+
+//ADD DENTRY METHOD
+
+void lfs_addDentry(int parent, int ID, const char *name, int type) {
+  lfs_dentry *lfs_entry;
+  lfs_entry = malloc(sizeof(lfs_dentry));
+  
+  lfs_entry->parent = parent;
+  lfs_entry->ID = ID;
+  lfs_entry->type = type;
+  memset(lfs_entry->name, 0, MAX_LENGTH+1);
+  strncpy(lfs_entry->name, name, MAX_LENGTH);
+  
+  unsigned int lfs_bucket;
+  lfs_bucket = lfs_hash(parent, lfs_entry->name) % DENTRY_BUCKETS;
+  lfs_entry->next = lfs_dentryTable[lfs_bucket];
+  lfs_dentryTable[lfs_bucket] = lfs_entry;
+}
+
+//REMOVE DENTRY METHOD
+
+void lfs_removeDentry(int parent, int ID) {
+  //the bucket is keyed by name, which the caller may not have, so check every bucket
+  int i;
+  for(i=0; i<DENTRY_BUCKETS; i++) {
+    lfs_dentry **lfs_link;
+    lfs_link = &lfs_dentryTable[i];
+    while(*lfs_link != NULL) {
+      if((*lfs_link)->parent == parent && (*lfs_link)->ID == ID) {
+        lfs_dentry *lfs_entry;
+        lfs_entry = *lfs_link;
+        *lfs_link = lfs_entry->next;
+        free(lfs_entry);
+        
+        return;
+      }
+      lfs_link = &(*lfs_link)->next;
+    }
+  }
+}
+
+//FORGET DIRECTORY METHOD
+
+void lfs_forgetDirectory(int parent) {
+  //drop every cached child of a directory whose inode ID is being freed
+  int i;
+  for(i=0; i<DENTRY_BUCKETS; i++) {
+    lfs_dentry **lfs_link;
+    lfs_link = &lfs_dentryTable[i];
+    while(*lfs_link != NULL) {
+      if((*lfs_link)->parent == parent) {
+        lfs_dentry *lfs_entry;
+        lfs_entry = *lfs_link;
+        *lfs_link = lfs_entry->next;
+        free(lfs_entry);
+      } else {
+        lfs_link = &(*lfs_link)->next;
+      }
+    }
+  }
+  lfs_dirCached[parent] = 0;
+}
+
+//LOOKUP PATH METHOD
+
+int lfs_lookupPath(const char *path, int *ID) {
+  lfs_pathEntry *lfs_entry;
+  lfs_entry = lfs_pathTable[lfs_hash(0, path) % PATH_BUCKETS];
+  while(lfs_entry != NULL) {
+    if(!strcmp(lfs_entry->path, path)) {
+      *ID = lfs_entry->ID;
+      return 1;
+    }
+    lfs_entry = lfs_entry->next;
+  }
+  return 0;
+}
+
+//ADD PATH METHOD
+
+void lfs_addPath(const char *path, int ID) {
+  //keep the cache bounded
+  if(lfs_pathEntries >= MAX_PATH_ENTRIES) {
+    lfs_clearPaths();
+  }
+  
+  lfs_pathEntry *lfs_entry;
+  lfs_entry = malloc(sizeof(lfs_pathEntry));
+  lfs_entry->path = malloc(strlen(path)+1);
+  memcpy(lfs_entry->path, path, strlen(path)+1);
+  lfs_entry->ID = ID;
+  
+  unsigned int lfs_bucket;
+  lfs_bucket = lfs_hash(0, path) % PATH_BUCKETS;
+  lfs_entry->next = lfs_pathTable[lfs_bucket];
+  lfs_pathTable[lfs_bucket] = lfs_entry;
+  lfs_pathEntries++;
+}
+
+//DROP PATH METHOD
+
+void lfs_dropPath(const char *path) {
+  lfs_pathEntry **lfs_link;
+  lfs_link = &lfs_pathTable[lfs_hash(0, path) % PATH_BUCKETS];
+  while(*lfs_link != NULL) {
+    if(!strcmp((*lfs_link)->path, path)) {
+      lfs_pathEntry *lfs_entry;
+      lfs_entry = *lfs_link;
+      *lfs_link = lfs_entry->next;
+      free(lfs_entry->path);
+      free(lfs_entry);
+      lfs_pathEntries--;
+      
+      return;
+    }
+    lfs_link = &(*lfs_link)->next;
+  }
+}
+
+//CLEAR PATHS METHOD
+
+void lfs_clearPaths(void) {
+  //removing or renaming a directory changes every path below it, so forget all of them
+  int i;
+  for(i=0; i<PATH_BUCKETS; i++) {
+    while(lfs_pathTable[i] != NULL) {
+      lfs_pathEntry *lfs_entry;
+      lfs_entry = lfs_pathTable[i];
+      lfs_pathTable[i] = lfs_entry->next;
+      free(lfs_entry->path);
+      free(lfs_entry);
+    }
+  }
+  lfs_pathEntries = 0;
+}
+
+//NEXT ENTRY METHOD
+
+lfs_dirEntry *lfs_nextEntry(inode *lfs_inode, off_t *offset) {
+  //the offset is a byte position in the directory, the next used entry at or after it is returned
+  while(*offset < lfs_inode->size) {
+    int lfs_index = *offset / BLOCK_SIZE;
+    int lfs_within = *offset % BLOCK_SIZE;
+    int lfs_pointer;
+    lfs_pointer = lfs_getBlockPointer(lfs_inode, lfs_index);
+    
+    //a hole or a damaged entry ends the block
+    lfs_dirEntry *lfs_entry = NULL;
+    if(lfs_pointer != -1 && lfs_within + DIRENT_HEADER <= BLOCK_SIZE) {
+      lfs_entry = (lfs_dirEntry *)(lfs_disk_in_memory + (lfs_pointer * BLOCK_SIZE) + lfs_within);
+      if(lfs_entry->length < DIRENT_HEADER || lfs_within + lfs_entry->length > BLOCK_SIZE) {
+        lfs_entry = NULL;
+      }
+    }
+    if(lfs_entry == NULL) {
+      *offset = (off_t)(lfs_index + 1) * BLOCK_SIZE;
+      continue;
+    }
+    
+    *offset += lfs_entry->length;
+    if(lfs_entry->ID != -1 && lfs_entry->nameLength <= MAX_LENGTH && DIRENT_SIZE(lfs_entry->nameLength) <= lfs_entry->length) {
+      return lfs_entry;
+    }
+  }
+  return NULL;
+}
+
+//ENTRY MATCHES METHOD
+
+int lfs_entryMatches(lfs_dirEntry *lfs_entry, const char *name) {
+  //names are compared up to MAX_LENGTH, like the dentry cache does
+  int lfs_length = strnlen(name, MAX_LENGTH);
+  return lfs_entry->nameLength == lfs_length && !memcmp(lfs_entry->name, name, lfs_length);
+}
+
+//FIND ROOM METHOD
+
+int lfs_findRoom(char *block, int needed) {
+  //the slack behind an entry is split off when the new entry fits, -1 if the block is full
+  int lfs_offset = 0;
+  while(lfs_offset + DIRENT_HEADER <= BLOCK_SIZE) {
+    lfs_dirEntry *lfs_entry;
+    lfs_entry = (lfs_dirEntry *)(block + lfs_offset);
+    if(lfs_entry->length < DIRENT_HEADER || lfs_offset + lfs_entry->length > BLOCK_SIZE) {
+      return -1;
+    }
+    
+    int lfs_used = lfs_entry->ID == -1 ? 0 : DIRENT_SIZE(lfs_entry->nameLength);
+    if(lfs_entry->length - lfs_used >= needed) {
+      if(lfs_used == 0) {
+        return lfs_offset;
+      }
+      lfs_dirEntry *lfs_free;
+      lfs_free = (lfs_dirEntry *)(block + lfs_offset + lfs_used);
+      lfs_free->ID = -1;
+      lfs_free->length = lfs_entry->length - lfs_used;
+      lfs_entry->length = lfs_used;
+      
+      return lfs_offset + lfs_used;
+    }
+    lfs_offset += lfs_entry->length;
+  }
+  return -1;
+}
+
+//ADD ENTRY METHOD
+
+int lfs_addEntry(lfs_openFile *lfs_dir, const char *name, int ID, int type) {
+  //the caller holds the directory lock, the first block with room or a hole takes the entry
+  int lfs_nameLength = strnlen(name, MAX_LENGTH);
+  int lfs_needed = DIRENT_SIZE(lfs_nameLength);
+  int lfs_blocks = (lfs_dir->inode.size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  
+  char *lfs_block;
+  lfs_block = malloc(BLOCK_SIZE);
+  int lfs_offset = -1;
+  int i;
+  for(i=0; i<=lfs_blocks && lfs_offset == -1; i++) {
+    int lfs_pointer = -1;
+    if(i < lfs_blocks) {
+      lfs_pointer = lfs_getBlockPointer(&lfs_dir->inode, i);
+    }
+    if(lfs_pointer == -1) {
+      //a new block is one free entry
+      memset(lfs_block, 0, BLOCK_SIZE);
+      ((lfs_dirEntry *) lfs_block)->ID = -1;
+      ((lfs_dirEntry *) lfs_block)->length = BLOCK_SIZE;
+    } else {
+      memcpy(lfs_block, lfs_disk_in_memory + (lfs_pointer * BLOCK_SIZE), BLOCK_SIZE);
+    }
+    lfs_offset = lfs_findRoom(lfs_block, lfs_needed);
+  }
+  i--;
+  
+  lfs_dirEntry *lfs_entry;
+  lfs_entry = (lfs_dirEntry *)(lfs_block + lfs_offset);
+  lfs_entry->ID = ID;
+  lfs_entry->nameLength = lfs_nameLength;
+  lfs_entry->type = type;
+  memcpy(lfs_entry->name, name, lfs_nameLength);
+  
+  int res;
+  res = lfs_writeDirectoryBlock(lfs_dir, i, lfs_block);
+  if(res == 0 && i == lfs_blocks) {
+    lfs_dir->inode.size = (off_t)(i + 1) * BLOCK_SIZE;
+  }
+  free(lfs_block);
+  
+  return res;
+}
+
+//REMOVE ENTRY METHOD
+
+int lfs_removeEntry(lfs_openFile *lfs_dir, const char *name) {
+  //the caller holds the directory lock, the entry's space goes to the one before it
+  int lfs_blocks = (lfs_dir->inode.size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  
+  char *lfs_block;
+  lfs_block = malloc(BLOCK_SIZE);
+  int i;
+  for(i=0; i<lfs_blocks; i++) {
+    int lfs_pointer;
+    lfs_pointer = lfs_getBlockPointer(&lfs_dir->inode, i);
+    if(lfs_pointer == -1) {
+      continue;
+    }
+    memcpy(lfs_block, lfs_disk_in_memory + (lfs_pointer * BLOCK_SIZE), BLOCK_SIZE);
+    
+    lfs_dirEntry *lfs_previous = NULL;
+    int lfs_offset = 0;
+    while(lfs_offset + DIRENT_HEADER <= BLOCK_SIZE) {
+      lfs_dirEntry *lfs_entry;
+      lfs_entry = (lfs_dirEntry *)(lfs_block + lfs_offset);
+      if(lfs_entry->length < DIRENT_HEADER || lfs_offset + lfs_entry->length > BLOCK_SIZE) {
+        break;
+      }
+      if(lfs_entry->ID != -1 && lfs_entryMatches(lfs_entry, name)) {
+        //the header left inside the previous entry's slack is marked free too, a scan starting on it never sees the child
+        if(lfs_previous != NULL) {
+          lfs_previous->length += lfs_entry->length;
+        }
+        lfs_entry->ID = -1;
+        
+        int res;
+        res = lfs_writeDirectoryBlock(lfs_dir, i, lfs_block);
+        free(lfs_block);
+        
+        return res;
+      }
+      lfs_previous = lfs_entry;
+      lfs_offset += lfs_entry->length;
+    }
+  }
+  free(lfs_block);
+  
+  return -ENOENT;
+}
+
+//DROP ENTRY METHOD
+
+int lfs_dropEntry(lfs_openFile *lfs_dir, const char *name) {
+  //the caller holds the directory lock, a remove gives space back, so it may take the cleaner's reserve when the log is full
+  int res;
+  res = lfs_removeEntry(lfs_dir, name);
+  if(res == -ENOSPC) {
+    pthread_mutex_lock(&lfs_logLock);
+    lfs_removing = 1;
+    pthread_mutex_unlock(&lfs_logLock);
+    res = lfs_removeEntry(lfs_dir, name);
+    pthread_mutex_lock(&lfs_logLock);
+    lfs_removing = 0;
+    pthread_mutex_unlock(&lfs_logLock);
+  }
+  
+  return res;
+}
+
+//REPLACE ENTRY METHOD
+
+int lfs_replaceEntry(lfs_openFile *lfs_dir, const char *name, int ID, int type) {
+  //the caller holds the directory lock, the entry keeps its name and place but names another inode
+  int lfs_blocks = (lfs_dir->inode.size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  
+  char *lfs_block;
+  lfs_block = malloc(BLOCK_SIZE);
+  int i;
+  for(i=0; i<lfs_blocks; i++) {
+    int lfs_pointer;
+    lfs_pointer = lfs_getBlockPointer(&lfs_dir->inode, i);
+    if(lfs_pointer == -1) {
+      continue;
+    }
+    memcpy(lfs_block, lfs_disk_in_memory + (lfs_pointer * BLOCK_SIZE), BLOCK_SIZE);
+    
+    int lfs_offset = 0;
+    while(lfs_offset + DIRENT_HEADER <= BLOCK_SIZE) {
+      lfs_dirEntry *lfs_entry;
+      lfs_entry = (lfs_dirEntry *)(lfs_block + lfs_offset);
+      if(lfs_entry->length < DIRENT_HEADER || lfs_offset + lfs_entry->length > BLOCK_SIZE) {
+        break;
+      }
+      if(lfs_entry->ID != -1 && lfs_entryMatches(lfs_entry, name)) {
+        lfs_entry->ID = ID;
+        lfs_entry->type = type;
+        
+        int res;
+        res = lfs_writeDirectoryBlock(lfs_dir, i, lfs_block);
+        free(lfs_block);
+        
+        return res;
+      }
+      lfs_offset += lfs_entry->length;
+    }
+  }
+  free(lfs_block);
+  
+  return -ENOENT;
+}
+
+//WRITE DIRECTORY BLOCK METHOD
+
+int lfs_writeDirectoryBlock(lfs_openFile *lfs_dir, int index, char *block) {
+  //a changed directory block is appended like file data, a block without entries becomes a hole
+  int res;
+  lfs_dirEntry *lfs_first;
+  lfs_first = (lfs_dirEntry *) block;
+  int lfs_current;
+  lfs_current = lfs_getBlockPointer(&lfs_dir->inode, index);
+  if(lfs_first->ID == -1 && lfs_first->length == BLOCK_SIZE) {
+    res = lfs_setBlockPointer(&lfs_dir->inode, index, -1);
+  } else if(lfs_current != -1 && lfs_updateUnwritten(lfs_current, 0, block, BLOCK_SIZE)) {
+    //appended since the last snapshot of the inode map, so a burst of creates changes the block in place
+    res = 0;
+  } else {
+    int lfs_blockPointer;
+    lfs_blockPointer = lfs_insertData(block, BLOCK_SIZE, lfs_dir->inode.ID, lfs_dir->inode.version, SUMMARY_DATA, index);
+    if(lfs_blockPointer == -1) {
+      return -ENOSPC;
+    }
+    res = lfs_setBlockPointer(&lfs_dir->inode, index, lfs_blockPointer);
+    if(res != 0) {
+      lfs_freeBlock(lfs_blockPointer);
+    }
+  }
+  if(res != 0) {
+    return res;
+  }
+  
+  //holes at the end are not part of the directory
+  while(lfs_dir->inode.size > 0 && lfs_getBlockPointer(&lfs_dir->inode, (lfs_dir->inode.size - 1) / BLOCK_SIZE) == -1) {
+    lfs_dir->inode.size = (lfs_dir->inode.size - 1) / BLOCK_SIZE * BLOCK_SIZE;
+  }
+  lfs_dir->inode.modify = time(NULL);
+  lfs_dir->dirty = 1;
+  
+  return 0;
+}
+
+//CREATE INODE METHOD
+
+int lfs_createInode(const char * path, int type) {
+  printf("createInode method called\n");
+  
+  //create inode pointer
+  inode *lfs_inode;
+  lfs_inode = malloc(sizeof(inode));
+  memset(lfs_inode, 0, sizeof(inode));
+  
+  //copy the path
+  char *lfs_path;
+  lfs_path = malloc(strlen(path)+1);
+  memset(lfs_path, 0, strlen(path)+1);
+  memcpy(lfs_path, path, strlen(path)+1);
+  
+  //set the inode type
+  lfs_inode->type = type;
+
+  //set the inode name
+  if(strlen(basename(lfs_path)) < MAX_LENGTH) {
+    memset(lfs_inode->name, 0, strlen(basename(lfs_path)));
+    memcpy(lfs_inode->name, basename(lfs_path), strlen(basename(lfs_path)));
+  }
+  else {
+    memset(lfs_inode->name, 0, strlen(basename(lfs_path)));
+    memcpy(lfs_inode->name, basename(lfs_path), MAX_LENGTH);
+  }
+  
+  //set the modify and access stamps
+  lfs_inode->modify = time(NULL);
+  lfs_inode->access = time(NULL);
+  
+  //blocks still carrying an older file's version in their summary are dead without looking further
+  pthread_mutex_lock(&lfs_logLock);
+  lfs_inode->version = lfs_sequence;
+  pthread_mutex_unlock(&lfs_logLock);
+  
+  //set the size
+  lfs_inode->size = 0;
+  
+  int j;
+  for(j=0; j<NUMBER_OF_DATAPOINTERS; j++) {
+    lfs_inode->datapointer[j] = -1;
+  }
+  
+  lfs_inode->indirectDataPointer = -1;
+  lfs_inode->doubleIndirectDataPointer = -1;
+  lfs_inode->tripleIndirectDataPointer = -1;
+  
+  //new files start out mapped by an extent list
+  if(type == 1 && lfs_useExtents) {
+    lfs_inode->flags |= INODE_EXTENTS;
+    lfs_inode->extentCount = 0;
+    lfs_inode->extentPointer = -1;
+  }
+  
+  //and keep their data in the inode until it outgrows it
+  if(type == 1) {
+    lfs_inode->flags |= INODE_INLINE;
+  }
+  
+  //find the parent inode
+  memset(lfs_path, 0, strlen(path)+1);
+  memcpy(lfs_path, path, strlen(path)+1);
+  
+  int lfs_parentInodeID;
+  lfs_parentInodeID = lfs_findInodeID(dirname(lfs_path));
+  free(lfs_path);
+  if(lfs_parentInodeID == -1) {
+    free(lfs_inode);
+    
+    return -ENOENT;
+  }
+  
+  //names are unique within a directory
+  if(lfs_findInodeID(path) != -1) {
+    free(lfs_inode);
+    
+    return -EEXIST;
+  }
+  
+  //take a free ID from the bitmap, only one create runs at a time
+  int i;
+  pthread_rwlock_rdlock(&lfs_mapLock);
+  i = lfs_findFreeInode();
+  pthread_rwlock_unlock(&lfs_mapLock);
+  if(i == -1) {
+    //No space for a new inode
+    free(lfs_inode);
+    
+    return -ENOMEM;
+  }
+  
+  //insert the new inode into the array
+  lfs_inode->ID = i;
+  if(lfs_writeInode(lfs_inode, NULL) != 0) {
+    free(lfs_inode);
+    
+    return -ENOSPC;
+  }
+  
+  //get the parent inode
+  lfs_openFile *lfs_parent;
+  lfs_parent = lfs_pinInode(lfs_parentInodeID);
+  pthread_rwlock_wrlock(&lfs_parent->lock);
+  
+  //add the entry to the first directory block with room, or a new one at the end
+  int res;
+  res = lfs_parent->inode.type != 0 ? -ENOTDIR : lfs_addEntry(lfs_parent, lfs_inode->name, i, type);
+  if(res != 0) {
+    pthread_rwlock_unlock(&lfs_parent->lock);
+    lfs_unpinInode(lfs_parent);
+    int lfs_inodeBlock;
+    pthread_rwlock_wrlock(&lfs_mapLock);
+    lfs_inodeBlock = lfs_inodeArray[i];
+    lfs_setInodeEntry(i, -1);
+    pthread_rwlock_unlock(&lfs_mapLock);
+    lfs_freeInode(lfs_inodeBlock);
+    free(lfs_inode);
+    
+    return res;
+  }
+  pthread_rwlock_unlock(&lfs_parent->lock);
+  
+  //the parent waits in the table with its new directory block, repeated creates log it once
+  lfs_unpinInode(lfs_parent);
+  
+  //the new child is known, and its path no longer misses
+  if(lfs_dirCached[lfs_parentInodeID]) {
+    lfs_addDentry(lfs_parentInodeID, i, lfs_inode->name, type);
+  }
+  free(lfs_inode);
+  lfs_dirCached[i] = 1;
+  lfs_dropPath(path);
+  
+  return 0;
+}
+
+//REMOVE INODE METHOD
+
+int lfs_removeInode(const char * path) {
+  printf("remove inode method called\n");
+  
+  //find the inode
+  int lfs_inodeID;
+  lfs_inodeID = lfs_findInodeID(path);
+  if(lfs_inodeID == -1) {
+    return -ENOENT;
+  }
+  
+  //find the parent inode
+  char *lfs_path;
+  lfs_path = malloc(strlen(path)+1);
+  memcpy(lfs_path, path, strlen(path)+1);
+  
+  int lfs_parentInodeID;
+  lfs_parentInodeID = lfs_findInodeID(dirname(lfs_path));
+  memcpy(lfs_path, path, strlen(path)+1);
+  
+  //a directory goes only once it has no entries left
+  inode lfs_child;
+  if(lfs_getInode(lfs_inodeID, &lfs_child) == NULL) {
+    free(lfs_path);
+    
+    return -ENOENT;
+  }
+  off_t lfs_offset = 0;
+  if(lfs_child.type == 0 && lfs_nextEntry(&lfs_child, &lfs_offset) != NULL) {
+    free(lfs_path);
+    
+    return -ENOTEMPTY;
+  }
+  
+  //remove the entry from the parent's directory blocks
+  lfs_openFile *lfs_parent;
+  lfs_parent = lfs_pinInode(lfs_parentInodeID);
+  pthread_rwlock_wrlock(&lfs_parent->lock);
+  int res;
+  res = lfs_dropEntry(lfs_parent, basename(lfs_path));
+  pthread_rwlock_unlock(&lfs_parent->lock);
+  free(lfs_path);
+  
+  //release the updated parent for the next write back, and remove the original inode from the inode map
+  lfs_unpinInode(lfs_parent);
+  if(res != 0) {
+    return res;
+  }
+  lfs_dropInode(lfs_inodeID, lfs_parentInodeID);
+  
+  return 0;
+}
+
+//DROP INODE METHOD
+
+void lfs_dropInode(int ID, int parentID) {
+  //the caller holds the namespace lock and removed the last entry naming the inode
+  int lfs_inodeID = ID;
+  int lfs_parentInodeID = parentID;
+  
+  //an open file keeps its pinned inode and its blocks until release, but is never logged again
+  pthread_mutex_lock(&lfs_openLock);
+  pthread_rwlock_wrlock(&lfs_mapLock);
+  int lfs_inodeBlock;
+  lfs_inodeBlock = lfs_inodeArray[lfs_inodeID];
+  lfs_setInodeEntry(lfs_inodeID, -1);
+  lfs_openFile *lfs_file;
+  lfs_file = lfs_openFiles[lfs_inodeID];
+  inode *lfs_inode;
+  lfs_inode = lfs_findInode(lfs_inodeBlock, lfs_inodeID);
+  if(lfs_file != NULL && lfs_file->count == 0) {
+    //left in the table for a write back, nobody holds it and its newer blocks go right away
+    lfs_openFiles[lfs_inodeID] = NULL;
+    lfs_idleInodes--;
+    lfs_inode = &lfs_file->inode;
+  } else if(lfs_file != NULL) {
+    lfs_file->unlinked = 1;
+    lfs_file->next = lfs_unlinkedFiles;
+    lfs_unlinkedFiles = lfs_file;
+    lfs_openFiles[lfs_inodeID] = NULL;
+    lfs_inode = NULL;
+  }
+  pthread_rwlock_unlock(&lfs_mapLock);
+  if(lfs_inode != NULL) {
+    lfs_forEachBlock(lfs_inode, lfs_freeBlock);
+  }
+  if(lfs_file != NULL && lfs_inode == &lfs_file->inode) {
+    pthread_rwlock_destroy(&lfs_file->lock);
+    free(lfs_file);
+  }
+  lfs_freeInode(lfs_inodeBlock);
+  pthread_mutex_unlock(&lfs_openLock);
+  
+  //forget the child and every path that could lead through it
+  lfs_removeDentry(lfs_parentInodeID, lfs_inodeID);
+  lfs_forgetDirectory(lfs_inodeID);
+  lfs_clearPaths();
+}
+
+//WRITE INODE MAP METHOD
+
+int lfs_writeInodeMap(int head) {
+  //the caller holds the log lock, changed chunks go into the rest of the head segment, 1 if some did not fit
+  lfs_logHead *lfs_head;
+  lfs_head = &lfs_heads[head];
+  
+  //the dirty chunks are cleared below, so the map lock is taken for writing
+  pthread_rwlock_wrlock(&lfs_mapLock);
+  int c;
+  for(c=0; c<MAP_CHUNKS && lfs_mapDirtyCount > 0; c++) {
+    if(!lfs_mapDirty[c]) {
+      continue;
+    }
+    if(lfs_head->segment == -1 || lfs_head->block == SEGMENT_START(lfs_head->segment) + BLOCKS_PER_SEGMENT) {
+      break;
+    }
+    
+    //the last chunk can be shorter than a block
+    int lfs_entries = NUMBER_OF_INODES - c * MAP_ENTRIES;
+    if(lfs_entries > MAP_ENTRIES) {
+      lfs_entries = MAP_ENTRIES;
+    }
+    if(lfs_mapBlocks[c] != -1) {
+      lfs_usage[SEGMENT_OF(lfs_mapBlocks[c])].liveBytes -= BLOCK_SIZE;
+    }
+    lfs_mapBlocks[c] = lfs_placeBlock(head, (char *)(lfs_inodeArray + c * MAP_ENTRIES), lfs_entries * sizeof(int), -1, 0, SUMMARY_MAP, c);
+    lfs_mapDirty[c] = 0;
+    lfs_mapDirtyCount--;
+  }
+  
+  //headers can name the map once every changed chunk is in the log
+  int res;
+  res = lfs_mapDirtyCount > 0;
+  if(!res) {
+    memcpy(lfs_mapSnapshot, lfs_mapBlocks, MAP_CHUNKS * sizeof(int));
+    memcpy(lfs_snapshotHeads, lfs_heads, sizeof(lfs_heads));
+  }
+  pthread_rwlock_unlock(&lfs_mapLock);
+  
+  return res;
+}
+
+//LOAD INODE MAP METHOD
+
+void lfs_loadInodeMap(int *mapBlocks) {
+  //read the chunks named by a checkpoint or segment header, a chunk never logged has no inodes
+  memcpy(lfs_mapBlocks, mapBlocks, MAP_CHUNKS * sizeof(int));
+  int c;
+  for(c=0; c<MAP_CHUNKS; c++) {
+    int lfs_entries = NUMBER_OF_INODES - c * MAP_ENTRIES;
+    if(lfs_entries > MAP_ENTRIES) {
+      lfs_entries = MAP_ENTRIES;
+    }
+    if(lfs_mapBlocks[c] == -1) {
+      memset(lfs_inodeArray + c * MAP_ENTRIES, 0xff, lfs_entries * sizeof(int));
+    } else {
+      memcpy(lfs_inodeArray + c * MAP_ENTRIES, lfs_disk_in_memory + (lfs_mapBlocks[c] * BLOCK_SIZE), lfs_entries * sizeof(int));
+    }
+    lfs_mapDirty[c] = 0;
+  }
+  lfs_mapDirtyCount = 0;
+  memcpy(lfs_mapSnapshot, lfs_mapBlocks, MAP_CHUNKS * sizeof(int));
+  memcpy(lfs_snapshotHeads, lfs_heads, sizeof(lfs_heads));
+  
+  //rebuild the free bitmap, the bits past the last inode are never free
+  memset(lfs_inodeBitmap, 0, BITMAP_WORDS * sizeof(uint64_t));
+  int i;
+  for(i=0; i<BITMAP_WORDS * 64; i++) {
+    if(i >= NUMBER_OF_INODES || lfs_inodeArray[i] != -1) {
+      lfs_inodeBitmap[i / 64] |= (uint64_t) 1 << (i % 64);
+    }
+  }
+  lfs_freeHint = 0;
+  while(lfs_freeHint < BITMAP_WORDS && lfs_inodeBitmap[lfs_freeHint] == ~(uint64_t) 0) {
+    lfs_freeHint++;
+  }
+}
+
+//SET INODE ENTRY METHOD
+
+void lfs_setInodeEntry(int ID, int block) {
+  //the caller holds the map lock for writing, the chunk goes out with the next inode map
+  lfs_inodeArray[ID] = block;
+  if(!lfs_mapDirty[ID / MAP_ENTRIES]) {
+    lfs_mapDirty[ID / MAP_ENTRIES] = 1;
+    lfs_mapDirtyCount++;
+  }
+  
+  //keep the hint on the first word that still has a free ID
+  int w = ID / 64;
+  uint64_t lfs_bit = (uint64_t) 1 << (ID % 64);
+  if(block == -1) {
+    lfs_inodeBitmap[w] &= ~lfs_bit;
+    if(w < lfs_freeHint) {
+      lfs_freeHint = w;
+    }
+  } else {
+    lfs_inodeBitmap[w] |= lfs_bit;
+    while(lfs_freeHint < BITMAP_WORDS && lfs_inodeBitmap[lfs_freeHint] == ~(uint64_t) 0) {
+      lfs_freeHint++;
+    }
+  }
+}
+
+//FIND FREE INODE METHOD
+
+int lfs_findFreeInode(void) {
+  //the caller holds the map lock, the lowest free ID or -1
+  if(lfs_freeHint == BITMAP_WORDS) {
+    return -1;
+  }
+  
+  return lfs_freeHint * 64 + __builtin_ctzll(~lfs_inodeBitmap[lfs_freeHint]);
+}
+
+//INSERT DATA METHOD
+
+int lfs_insertData(char * data, int size, int ID, int version, int kind, int index) {
+  printf("insertData method called\n");
+  
+  //reserve the block and fill it in one step, the flusher only ever sees complete segments
+  int block;
+  pthread_mutex_lock(&lfs_logLock);
+  block = lfs_appendBlock(data, size, ID, version, kind, index);
+  pthread_mutex_unlock(&lfs_logLock);
+  
+  return block;
+}
+
+//APPEND BLOCK METHOD
+
+int lfs_appendBlock(char * data, int size, int ID, int version, int kind, int index) {
+  //the caller holds the log lock
+  int block;
+  int h;
+  h = lfs_pickHead(kind);
+  lfs_logHead *lfs_head;
+  lfs_head = &lfs_heads[h];
+  
+  //the log head segment is full or was never used, this head goes on in a clean segment
+  if((lfs_head->segment == -1 || lfs_head->block == SEGMENT_START(lfs_head->segment) + BLOCKS_PER_SEGMENT) && lfs_nextSegment(h) != 0) {
+    return -1;
+  }
+  block = lfs_placeBlock(h, data, size, ID, version, kind, index);
+  
+  //the changed chunks of the inode map take the last blocks, so the header of the full segment names a map inside it
+  int lfs_room;
+  lfs_room = SEGMENT_START(lfs_head->segment) + BLOCKS_PER_SEGMENT - lfs_head->block;
+  if(lfs_room <= MAP_CHUNKS) {
+    int lfs_dirty;
+    pthread_rwlock_rdlock(&lfs_mapLock);
+    lfs_dirty = lfs_mapDirtyCount;
+    pthread_rwlock_unlock(&lfs_mapLock);
+    if(lfs_room <= lfs_dirty) {
+      lfs_writeInodeMap(h);
+    }
+  }
+  
+  if(lfs_head->block == SEGMENT_START(lfs_head->segment) + BLOCKS_PER_SEGMENT) {
+    lfs_sealSegment(h);
+  }
+  
+  return block;
+}
+
+//PICK HEAD METHOD
+
+int lfs_pickHead(int kind) {
+  //blocks of a similar age share a segment: moved by the cleaner, file data, or metadata
+  if(lfs_cleaning) {
+    return HEAD_COLD;
+  }
+  if(kind == SUMMARY_DATA) {
+    return HEAD_DATA;
+  }
+  
+  return HEAD_HOT;
+}
+
+//PLACE BLOCK METHOD
+
+int lfs_placeBlock(int head, char * data, int size, int ID, int version, int kind, int index) {
+  //the caller holds the log lock and made sure the head segment has room
+  lfs_logHead *lfs_head;
+  lfs_head = &lfs_heads[head];
+  int block;
+  block = lfs_head->block;
+  
+  //insert the data into the disk in memory
+  memset(lfs_disk_in_memory + (block * BLOCK_SIZE), 0, BLOCK_SIZE);
+  memcpy(lfs_disk_in_memory + (block * BLOCK_SIZE), data, size);
+  lfs_usage[lfs_head->segment].liveBytes += BLOCK_SIZE;
+  lfs_usage[lfs_head->segment].modify = time(NULL);
+  
+  //record the owner in the segment summary, so the cleaner can tell if the block is still in use
+  lfs_summary *lfs_entry;
+  lfs_entry = lfs_getSummary(block);
+  lfs_entry->ID = ID;
+  lfs_entry->version = version;
+  lfs_entry->kind = kind;
+  lfs_entry->index = index;
+  
+  //incriment block
+  lfs_head->block++;
+  
+  //the partial segment counts its blocks, a full one makes way for the next
+  lfs_partialHeader *lfs_partial;
+  lfs_partial = (lfs_partialHeader *)(lfs_disk_in_memory + (lfs_partialStart[head] * BLOCK_SIZE));
+  lfs_partial->blocks++;
+  if(lfs_partial->blocks == PARTIAL_ENTRIES) {
+    lfs_openPartial(head);
+  }
+  
+  return block;
+}
+
+//SEAL SEGMENT METHOD
+
+void lfs_sealSegment(int head) {
+  //the segment is full, close its partial segments and write the header and chunk table at the beginning of the segment 
+  int lfs_first;
+  lfs_first = lfs_closePartials(head);
+  lfs_writeSegmentHeader(head, BLOCKS_PER_SEGMENT);
+  
+  //hand the full segment to the flusher and keep appending to a new one
+  lfs_queueSegment(lfs_heads[head].segment, lfs_first);
+  lfs_nextSegment(head);
+  
+  //the inodes of the table, parent directories among them, go to the log right behind the segment instead of waiting for the timer
+  lfs_writeBackWanted = 1;
+  pthread_cond_signal(&lfs_cleanWork);
+}
+
+//OPEN PARTIAL METHOD
+
+void lfs_openPartial(int head) {
+  //the caller holds the log lock, the next blocks of the head go into a new partial segment
+  lfs_logHead *lfs_head;
+  lfs_head = &lfs_heads[head];
+  int lfs_end = SEGMENT_START(lfs_head->segment) + BLOCKS_PER_SEGMENT;
+  lfs_partialStart[head] = -1;
+  if(lfs_head->block + PARTIAL_HEADER_BLOCKS >= lfs_end) {
+    //no room for a header and one block, the rest of the segment stays empty
+    lfs_head->block = lfs_end;
+    return;
+  }
+  
+  //the header is filled in when the partial segment is written
+  memset(lfs_disk_in_memory + (lfs_head->block * BLOCK_SIZE), 0, PARTIAL_HEADER_BLOCKS * BLOCK_SIZE);
+  int b;
+  for(b=lfs_head->block; b<lfs_head->block + PARTIAL_HEADER_BLOCKS; b++) {
+    lfs_summary *lfs_entry;
+    lfs_entry = lfs_getSummary(b);
+    lfs_entry->ID = -1;
+    lfs_entry->version = 0;
+    lfs_entry->kind = SUMMARY_PARTIAL;
+    lfs_entry->index = 0;
+  }
+  lfs_partialStart[head] = lfs_head->block;
+  lfs_head->block += PARTIAL_HEADER_BLOCKS;
+}
+
+//CLOSE PARTIALS METHOD
+
+int lfs_closePartials(int head) {
+  //the caller holds the log lock, partial segments not written yet get their header, returns the first block to write
+  //the blocks to write end where the next partial segment to write starts
+  lfs_logHead *lfs_head;
+  lfs_head = &lfs_heads[head];
+  int lfs_end = SEGMENT_START(lfs_head->segment) + BLOCKS_PER_SEGMENT;
+  int lfs_first = lfs_partialFirst[head];
+  int b = lfs_first;
+  while(b < lfs_head->block && b + PARTIAL_HEADER_BLOCKS < lfs_end) {
+    char *lfs_start;
+    lfs_start = lfs_disk_in_memory + (b * BLOCK_SIZE);
+    lfs_partialHeader *lfs_partial;
+    lfs_partial = (lfs_partialHeader *) lfs_start;
+    if(lfs_partial->blocks == 0) {
+      //the open partial segment is still empty, it stays open
+      break;
+    }
+    
+    //the inode map it names and the summary of its blocks, the checksums are added by whoever writes it
+    lfs_partial->magic = LFS_MAGIC;
+    lfs_partial->volume = lfs_volume;
+    lfs_partial->sequence = lfs_head->sequence;
+    lfs_headerSerial++;
+    lfs_partial->serial = lfs_headerSerial;
+    memcpy(lfs_partial->heads, lfs_snapshotHeads, sizeof(lfs_snapshotHeads));
+    memcpy(lfs_start + sizeof(lfs_partialHeader), lfs_mapSnapshot, MAP_CHUNKS * sizeof(int));
+    memcpy(lfs_start + sizeof(lfs_partialHeader) + MAP_CHUNKS * sizeof(int), lfs_getSummary(b + PARTIAL_HEADER_BLOCKS), lfs_partial->blocks * sizeof(lfs_summary));
+    
+    if(b == lfs_partialStart[head]) {
+      lfs_partialStart[head] = -1;
+    }
+    b += PARTIAL_HEADER_BLOCKS + lfs_partial->blocks;
+  }
+  lfs_partialFirst[head] = b;
+  
+  return lfs_first;
+}
+
+//NEXT PARTIAL METHOD
+
+lfs_partialHeader *lfs_nextPartial(int segment, int *block, int *sequence, int *serial) {
+  //the partial segment at block if it goes on the ones before it and all its blocks match their checksums, block moves past it
+  lfs_partialHeader *lfs_partial;
+  lfs_partial = lfs_partialAt(segment, *block, *sequence, *serial);
+  if(lfs_partial == NULL) {
+    return NULL;
+  }
+  lfs_summary *lfs_entries;
+  lfs_entries = (lfs_summary *)(((char *) lfs_partial) + sizeof(lfs_partialHeader) + MAP_CHUNKS * sizeof(int));
+  if(lfs_checkBlocks(*block + PARTIAL_HEADER_BLOCKS, lfs_entries, lfs_partial->blocks, 0) != 0) {
+    return NULL;
+  }
+  *sequence = lfs_partial->sequence;
+  *serial = lfs_partial->serial;
+  *block += PARTIAL_HEADER_BLOCKS + lfs_partial->blocks;
+  
+  return lfs_partial;
+}
+
+//PARTIAL AT METHOD
+
+lfs_partialHeader *lfs_partialAt(int segment, int block, int sequence, int serial) {
+  //the header at block if it is whole and goes on the partial segments before it
+  //the first one sets the sequence of the segment, serials rise along it so one left from before a crash ends it
+  int lfs_end = SEGMENT_START(segment) + BLOCKS_PER_SEGMENT;
+  if(block + PARTIAL_HEADER_BLOCKS >= lfs_end) {
+    return NULL;
+  }
+  lfs_partialHeader *lfs_partial;
+  lfs_partial = (lfs_partialHeader *)(lfs_disk_in_memory + (block * BLOCK_SIZE));
+  if(lfs_partial->magic != LFS_MAGIC || lfs_partial->volume != lfs_volume || lfs_partial->blocks <= 0 || lfs_partial->blocks > PARTIAL_ENTRIES || block + PARTIAL_HEADER_BLOCKS + lfs_partial->blocks > lfs_end) {
+    return NULL;
+  }
+  if((sequence != -1 && lfs_partial->sequence != sequence) || lfs_partial->serial <= serial) {
+    return NULL;
+  }
+  if(lfs_regionChecksum(lfs_partial, PARTIAL_HEADER_BLOCKS * BLOCK_SIZE, offsetof(lfs_partialHeader, checksum)) != lfs_partial->checksum) {
+    return NULL;
+  }
+  
+  return lfs_partial;
+}
+
+//SUM PARTIALS METHOD
+
+void lfs_sumPartials(int block, int end) {
+  //closed partial segments from block on get the checksum of every block, then of their header
+  //nobody changes their blocks any more, so this needs no lock and the flusher does it for full segments
+  int lfs_end = SEGMENT_START(SEGMENT_OF(block)) + BLOCKS_PER_SEGMENT;
+  while(block < end && block + PARTIAL_HEADER_BLOCKS < lfs_end) {
+    lfs_partialHeader *lfs_partial;
+    lfs_partial = (lfs_partialHeader *)(lfs_disk_in_memory + (block * BLOCK_SIZE));
+    if(lfs_partial->magic != LFS_MAGIC || lfs_partial->blocks <= 0) {
+      //an open partial segment, nothing after it was closed
+      break;
+    }
+    lfs_summary *lfs_entries;
+    lfs_entries = (lfs_summary *)(((char *) lfs_partial) + sizeof(lfs_partialHeader) + MAP_CHUNKS * sizeof(int));
+    int i;
+    for(i=0; i<lfs_partial->blocks; i++) {
+      int b = block + PARTIAL_HEADER_BLOCKS + i;
+      lfs_entries[i].checksum = lfs_blockChecksum(b);
+      lfs_getSummary(b)->checksum = lfs_entries[i].checksum;
+    }
+    lfs_partial->checksum = lfs_regionChecksum(lfs_partial, PARTIAL_HEADER_BLOCKS * BLOCK_SIZE, offsetof(lfs_partialHeader, checksum));
+    block += PARTIAL_HEADER_BLOCKS + lfs_partial->blocks;
+  }
+}
+
+//CHECK BLOCKS METHOD
+
+int lfs_checkBlocks(int block, lfs_summary *entries, int blocks, int report) {
+  //count the blocks from block on that no longer match the checksum in their summary entry
+  int lfs_bad = 0;
+  int i;
+  for(i=0; i<blocks; i++) {
+    if(entries[i].kind == -1 || entries[i].kind == SUMMARY_PARTIAL) {
+      //an unused block, or a header that has a checksum of its own
+      continue;
+    }
+    if(lfs_blockChecksum(block + i) != entries[i].checksum) {
+      if(report) {
+        printf("block %d does not match its checksum\n", block + i);
+      }
+      lfs_bad++;
+    }
+  }
+  
+  return lfs_bad;
+}
+
+//WALK PARTIALS METHOD
+
+int lfs_walkPartials(int segment, int until, int *sequence, int rebuild) {
+  //follow the partial segments up to the first one starting at or past until, returns where the last one ends
+  //with rebuild their summaries are copied back into the summary of the segment
+  int lfs_block = SEGMENT_START(segment) + SEGMENT_HEADER_BLOCKS;
+  int lfs_serial = 0;
+  while(lfs_block < until) {
+    int lfs_start = lfs_block;
+    lfs_partialHeader *lfs_partial;
+    lfs_partial = lfs_nextPartial(segment, &lfs_block, sequence, &lfs_serial);
+    if(lfs_partial == NULL) {
+      break;
+    }
+    if(!rebuild) {
+      continue;
+    }
+    int b;
+    for(b=lfs_start; b<lfs_start + PARTIAL_HEADER_BLOCKS; b++) {
+      lfs_summary *lfs_entry;
+      lfs_entry = lfs_getSummary(b);
+      lfs_entry->ID = -1;
+      lfs_entry->version = 0;
+      lfs_entry->kind = SUMMARY_PARTIAL;
+      lfs_entry->index = 0;
+    }
+    memcpy(lfs_getSummary(lfs_start + PARTIAL_HEADER_BLOCKS), ((char *) lfs_partial) + sizeof(lfs_partialHeader) + MAP_CHUNKS * sizeof(int), lfs_partial->blocks * sizeof(lfs_summary));
+  }
+  
+  return lfs_block;
+}
+
+//SEGMENT END METHOD
+
+int lfs_segmentEnd(int segment) {
+  //after a mount, the end of what a segment holds: a full one has its header, one never filled only its partial segments
+  lfs_segmentHeader *lfs_header;
+  lfs_header = (lfs_segmentHeader *)(lfs_disk_in_memory + (SEGMENT_START(segment) * BLOCK_SIZE));
+  int lfs_sealed = lfs_validHeader(segment);
+  int lfs_end = SEGMENT_START(segment) + BLOCKS_PER_SEGMENT;
+  int lfs_sequence = -1;
+  int lfs_reach;
+  lfs_reach = lfs_walkPartials(segment, lfs_end, &lfs_sequence, 0);
+  
+  //the partial segments of a newer use than the header, their summary was never written at the start of the segment
+  if(lfs_sequence != -1 && (!lfs_sealed || lfs_sequence > lfs_header->sequence)) {
+    lfs_walkPartials(segment, lfs_end, &lfs_sequence, 1);
+    memset(lfs_getSummary(lfs_reach), 0xff, (lfs_end - lfs_reach) * sizeof(lfs_summary));
+    
+    return lfs_reach;
+  }
+  if(lfs_sealed) {
+    return SEGMENT_START(segment) + (lfs_header->blocks < BLOCKS_PER_SEGMENT ? lfs_header->blocks : BLOCKS_PER_SEGMENT);
+  }
+  
+  return SEGMENT_START(segment);
+}
+
+//VALID HEADER METHOD
+
+int lfs_validHeader(int segment) {
+  //a header written for this volume whose chunk table and summary are whole
+  lfs_segmentHeader *lfs_header;
+  lfs_header = (lfs_segmentHeader *)(lfs_disk_in_memory + (SEGMENT_START(segment) * BLOCK_SIZE));
+  if(lfs_header->magic != LFS_MAGIC || lfs_header->volume != lfs_volume) {
+    return 0;
+  }
+  
+  return lfs_regionChecksum(lfs_header, SEGMENT_HEADER_BLOCKS * BLOCK_SIZE, offsetof(lfs_segmentHeader, checksum)) == lfs_header->checksum;
+}
+
+//VALID CHECKPOINT METHOD
+
+int lfs_validCheckpoint(int region) {
+  //a checkpoint of this volume that was written completely
+  char *lfs_region;
+  lfs_region = lfs_disk_in_memory + (CHECKPOINT_START(region) * BLOCK_SIZE);
+  lfs_checkpoint *lfs_cp;
+  lfs_cp = (lfs_checkpoint *) lfs_region;
+  int lfs_trailer;
+  lfs_trailer = *(int *)(lfs_region + (CHECKPOINT_BLOCKS * BLOCK_SIZE) - sizeof(int));
+  if(lfs_cp->magic != LFS_MAGIC || lfs_cp->volume != lfs_volume || lfs_cp->serial != lfs_trailer) {
+    return 0;
+  }
+  
+  return lfs_regionChecksum(lfs_region, CHECKPOINT_BLOCKS * BLOCK_SIZE, offsetof(lfs_checkpoint, checksum)) == lfs_cp->checksum;
+}
+
+//REGION CHECKSUM METHOD
+
+unsigned int lfs_regionChecksum(const void *start, size_t size, size_t field) {
+  //the checksum of a header counts its own checksum field as 0
+  unsigned int lfs_zero = 0;
+  unsigned int res;
+  res = lfs_checksum(0, start, field);
+  res = lfs_checksum(res, &lfs_zero, sizeof(lfs_zero));
+  res = lfs_checksum(res, ((const char *) start) + field + sizeof(lfs_zero), size - field - sizeof(lfs_zero));
+  
+  return res;
+}
+
+//BLOCK CHECKSUM METHOD
+
+unsigned int lfs_blockChecksum(int block) {
+  return lfs_checksum(0, lfs_disk_in_memory + (block * BLOCK_SIZE), BLOCK_SIZE);
+}
+
+//INIT CHECKSUM METHOD
+
+void lfs_initChecksum(void) {
+  //the table of one byte, then each byte followed by more zeros, for eight bytes per step without the instruction
+  unsigned int n;
+  for(n=0; n<256; n++) {
+    unsigned int lfs_crc = n;
+    int k;
+    for(k=0; k<8; k++) {
+      lfs_crc = (lfs_crc & 1) ? (lfs_crc >> 1) ^ CRC32C_POLY : lfs_crc >> 1;
+    }
+    lfs_crcTable[0][n] = lfs_crc;
+  }
+  for(n=0; n<256; n++) {
+    int k;
+    for(k=1; k<8; k++) {
+      lfs_crcTable[k][n] = (lfs_crcTable[k-1][n] >> 8) ^ lfs_crcTable[0][lfs_crcTable[k-1][n] & 0xff];
+    }
+  }
+  
+  //the instruction runs three streams side by side, their crcs are joined by moving one past the length of the next
+  lfs_crcZeros(lfs_crcLong, CRC_LONG);
+  lfs_crcZeros(lfs_crcShort, CRC_SHORT);
+#if defined(__x86_64__)
+  lfs_crcHardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+//CRC ZEROS METHOD
+
+void lfs_crcZeros(unsigned int table[][256], size_t length) {
+  //moving a crc past zeros is linear, so it is the xor of what happens to each of its 32 bits
+  unsigned int lfs_bits[32];
+  int i;
+  for(i=0; i<32; i++) {
+    unsigned int lfs_crc = 1u << i;
+    size_t z;
+    for(z=0; z<length; z++) {
+      lfs_crc = lfs_crcTable[0][lfs_crc & 0xff] ^ (lfs_crc >> 8);
+    }
+    lfs_bits[i] = lfs_crc;
+  }
+  int k;
+  for(k=0; k<4; k++) {
+    unsigned int n;
+    for(n=0; n<256; n++) {
+      unsigned int lfs_crc = 0;
+      int j;
+      for(j=0; j<8; j++) {
+        if(n & (1u << j)) {
+          lfs_crc ^= lfs_bits[k * 8 + j];
+        }
+      }
+      table[k][n] = lfs_crc;
+    }
+  }
+}
+
+//CRC SHIFT METHOD
+
+unsigned int lfs_crcShift(unsigned int table[][256], unsigned int crc) {
+  return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+//CHECKSUM METHOD
+
+unsigned int lfs_checksum(unsigned int crc, const void *data, size_t size) {
+  //crc32c, going on from the checksum of what came before, 0 to start
+#if defined(__x86_64__)
+  if(lfs_crcHardware) {
+    return lfs_checksumHardware(crc, data, size);
+  }
+#endif
+  
+  return lfs_checksumTable(crc, data, size);
+}
+
+//CHECKSUM TABLE METHOD
+
+unsigned int lfs_checksumTable(unsigned int crc, const void *data, size_t size) {
+  //eight bytes per step through the tables, the image is little endian
+  const unsigned char *lfs_next = data;
+  crc = ~crc;
+  while(size > 0 && ((uintptr_t) lfs_next & 7) != 0) {
+    crc = lfs_crcTable[0][(crc ^ *lfs_next++) & 0xff] ^ (crc >> 8);
+    size--;
+  }
+  while(size >= 8) {
+    uint64_t lfs_word;
+    memcpy(&lfs_word, lfs_next, 8);
+    unsigned int lfs_low = crc ^ (unsigned int) lfs_word;
+    unsigned int lfs_high = (unsigned int)(lfs_word >> 32);
+    crc = lfs_crcTable[7][lfs_low & 0xff] ^ lfs_crcTable[6][(lfs_low >> 8) & 0xff] ^ lfs_crcTable[5][(lfs_low >> 16) & 0xff] ^ lfs_crcTable[4][lfs_low >> 24] ^
+          lfs_crcTable[3][lfs_high & 0xff] ^ lfs_crcTable[2][(lfs_high >> 8) & 0xff] ^ lfs_crcTable[1][(lfs_high >> 16) & 0xff] ^ lfs_crcTable[0][lfs_high >> 24];
+    lfs_next += 8;
+    size -= 8;
+  }
+  while(size > 0) {
+    crc = lfs_crcTable[0][(crc ^ *lfs_next++) & 0xff] ^ (crc >> 8);
+    size--;
+  }
+  
+  return ~crc;
+}
+
+#if defined(__x86_64__)
+//CHECKSUM HARDWARE METHOD
+
+__attribute__((target("sse4.2")))
+unsigned int lfs_checksumHardware(unsigned int crc, const void *data, size_t size) {
+  //the crc32 instruction takes 3 cycles but starts one every cycle, so three streams over neighbouring ranges keep it busy
+  const unsigned char *lfs_next = data;
+  uint64_t lfs_crc0 = ~crc;
+  while(size > 0 && ((uintptr_t) lfs_next & 7) != 0) {
+    lfs_crc0 = _mm_crc32_u8(lfs_crc0, *lfs_next++);
+    size--;
+  }
+  size_t lfs_length = CRC_LONG;
+  unsigned int (*lfs_shift)[256] = lfs_crcLong;
+  while(1) {
+    while(size >= lfs_length * 3) {
+      uint64_t lfs_crc1 = 0;
+      uint64_t lfs_crc2 = 0;
+      const unsigned char *lfs_end = lfs_next + lfs_length;
+      while(lfs_next < lfs_end) {
+        lfs_crc0 = _mm_crc32_u64(lfs_crc0, *(const uint64_t *) lfs_next);
+        lfs_crc1 = _mm_crc32_u64(lfs_crc1, *(const uint64_t *)(lfs_next + lfs_length));
+        lfs_crc2 = _mm_crc32_u64(lfs_crc2, *(const uint64_t *)(lfs_next + lfs_length * 2));
+        lfs_next += 8;
+      }
+      lfs_crc0 = lfs_crcShift(lfs_shift, lfs_crc0) ^ lfs_crc1;
+      lfs_crc0 = lfs_crcShift(lfs_shift, lfs_crc0) ^ lfs_crc2;
+      lfs_next += lfs_length * 2;
+      size -= lfs_length * 3;
+    }
+    if(lfs_length == CRC_SHORT) {
+      break;
+    }
+    lfs_length = CRC_SHORT;
+    lfs_shift = lfs_crcShort;
+  }
+  while(size >= 8) {
+    lfs_crc0 = _mm_crc32_u64(lfs_crc0, *(const uint64_t *) lfs_next);
+    lfs_next += 8;
+    size -= 8;
+  }
+  while(size > 0) {
+    lfs_crc0 = _mm_crc32_u8(lfs_crc0, *lfs_next++);
+    size--;
+  }
+  
+  return ~(unsigned int) lfs_crc0;
+}
+#endif
+
+//NEXT SEGMENT METHOD
+
+int lfs_nextSegment(int head) {
+  //the caller holds the log lock, the log head moves on to the oldest clean segment
+  //one a read_buf reply may still splice from is only taken when every clean segment is
+  int lfs_next = -1;
+  int lfs_nextPinned = 0;
+  pthread_mutex_lock(&lfs_pinLock);
+  int s;
+  for(s=0; s<NUMBER_OF_SEGMENTS; s++) {
+    if(!lfs_usage[s].clean) {
+      continue;
+    }
+    int lfs_pinned;
+    lfs_pinned = lfs_isPinned(s);
+    if(lfs_next == -1 || lfs_pinned < lfs_nextPinned || (lfs_pinned == lfs_nextPinned && lfs_usage[s].modify < lfs_usage[lfs_next].modify)) {
+      lfs_next = s;
+      lfs_nextPinned = lfs_pinned;
+    }
+  }
+  pthread_mutex_unlock(&lfs_pinLock);
+  //the inode map may use the reserve too, a checkpoint cannot be taken without it
+  //changed inodes of the table stop short of the cleaner's reserve, every other writer also short of theirs
+  int lfs_reserve = CLEAN_RESERVE + INODE_RESERVE;
+  if(lfs_cleaning || lfs_mapWriting || lfs_removing) {
+    lfs_reserve = 0;
+  } else if(lfs_writingBack) {
+    lfs_reserve = CLEAN_RESERVE;
+  }
+  if(lfs_next == -1 || lfs_cleanCount <= lfs_reserve) {
+    //no clean segment left for writers, the head stays at the end of the full one until the cleaner made room
+    lfs_cleanerWanted = 1;
+    pthread_cond_signal(&lfs_cleanWork);
+    
+    return 1;
+  }
+  
+  //the segment may still be on its way to the harddisk, or be read by a reply libfuse has not sent yet
+  lfs_waitSegment(lfs_next);
+  pthread_mutex_lock(&lfs_pinLock);
+  while(lfs_isPinned(lfs_next)) {
+    struct timespec lfs_deadline;
+    clock_gettime(CLOCK_REALTIME, &lfs_deadline);
+    lfs_deadline.tv_sec += 1;
+    pthread_cond_timedwait(&lfs_pinReleased, &lfs_pinLock, &lfs_deadline);
+  }
+  pthread_mutex_unlock(&lfs_pinLock);
+  
+  lfs_usage[lfs_next].clean = 0;
+  lfs_usage[lfs_next].liveBytes = 0;
+  lfs_usage[lfs_next].modify = time(NULL);
+  lfs_cleanCount--;
+  
+  //below the low watermark the cleaner thread starts making room in the background
+  if(lfs_cleanCount < CLEAN_LOW) {
+    lfs_cleanerWanted = 1;
+    pthread_cond_signal(&lfs_cleanWork);
+  }
+  
+  //the old header no longer describes the segment, in a mapped image roll forward would read it before the new one is written
+  lfs_segmentHeader *lfs_old;
+  lfs_old = (lfs_segmentHeader *)(lfs_disk_in_memory + (SEGMENT_START(lfs_next) * BLOCK_SIZE));
+  lfs_old->magic = 0;
+  
+  //forget the owners of the blocks it held before
+  memset(lfs_disk_in_memory + ((SEGMENT_START(lfs_next) + SUMMARY_BLOCK) * BLOCK_SIZE), 0xff, SUMMARY_BLOCKS * BLOCK_SIZE);
+  
+  //skip the space for the segment header, chunk table and summary
+  lfs_sequence++;
+  lfs_heads[head].segment = lfs_next;
+  lfs_heads[head].block = SEGMENT_START(lfs_next) + SEGMENT_HEADER_BLOCKS;
+  lfs_heads[head].sequence = lfs_sequence;
+  lfs_inodeBlocks[head] = -1;
+  lfs_partialFirst[head] = lfs_heads[head].block;
+  lfs_openPartial(head);
+  
+  return 0;
+}
+
+//IS HEAD METHOD
+
+int lfs_isHead(int segment) {
+  //the log head appending to the segment, or -1, the caller holds the log lock
+  int h;
+  for(h=0; h<LOG_HEADS; h++) {
+    if(lfs_heads[h].segment == segment) {
+      return h;
+    }
+  }
+  
+  return -1;
+}
+
+//ON HARDDISK METHOD
+
+int lfs_onHarddisk(int block, int count) {
+  //blocks the image file holds as they are in memory, the caller holds the log lock
+  //a mapped image is the page cache, so every block does
+  if(lfs_mappedSize != 0) {
+    return 1;
+  }
+  int lfs_last = block + count - 1;
+  int s;
+  for(s=SEGMENT_OF(block); s<=SEGMENT_OF(lfs_last); s++) {
+    //partial segments a commit wrote never change again, the rest of a log head is only in memory
+    int h;
+    h = lfs_isHead(s);
+    if(h != -1) {
+      if(lfs_last >= lfs_partialFirst[h]) {
+        return 0;
+      }
+      continue;
+    }
+    
+    //a full segment is, once the flusher is done with it
+    int res = 1;
+    pthread_mutex_lock(&lfs_flushLock);
+    int i;
+    for(i=0; i<lfs_flushCount; i++) {
+      if(lfs_flushQueue[(lfs_flushFirst + i) % FLUSH_QUEUE].segment == s) {
+        res = 0;
+      }
+    }
+    pthread_mutex_unlock(&lfs_flushLock);
+    if(!res) {
+      return 0;
+    }
+  }
+  
+  return 1;
+}
+
+//PIN SEGMENT METHOD
+
+int lfs_pinSegment(int segment) {
+  //the caller holds the log lock, the segment is not reused while this thread's reply may splice from it
+  pthread_mutex_lock(&lfs_pinLock);
+  int lfs_held = 0;
+  int i;
+  for(i=0; i<lfs_threadPinCount; i++) {
+    if(lfs_threadPins[i] == segment) {
+      lfs_held = 1;
+    }
+  }
+  if(!lfs_held && lfs_threadPinCount == READ_PINS) {
+    //this reply already splices from as many segments as it may, the rest is copied
+    pthread_mutex_unlock(&lfs_pinLock);
+    return 0;
+  }
+  if(!lfs_held) {
+    lfs_threadPins[lfs_threadPinCount++] = segment;
+    lfs_usage[segment].readers++;
+  }
+  lfs_usage[segment].pinned = time(NULL);
+  pthread_mutex_unlock(&lfs_pinLock);
+  
+  return 1;
+}
+
+//UNPIN SEGMENTS METHOD
+
+void lfs_unpinSegments(void) {
+  //the reply that pinned the segments of this thread was sent, no log lock so a writer waiting for them never blocks this
+  if(lfs_threadPinCount == 0) {
+    return;
+  }
+  pthread_mutex_lock(&lfs_pinLock);
+  int i;
+  for(i=0; i<lfs_threadPinCount; i++) {
+    lfs_usage[lfs_threadPins[i]].readers--;
+  }
+  lfs_threadPinCount = 0;
+  pthread_cond_broadcast(&lfs_pinReleased);
+  pthread_mutex_unlock(&lfs_pinLock);
+}
+
+//IS PINNED METHOD
+
+int lfs_isPinned(int segment) {
+  //the caller holds the pin lock, a reader thread that stayed idle since its last reply has long sent it, its pins run out
+  return lfs_usage[segment].readers > 0 && time(NULL) - lfs_usage[segment].pinned < PIN_TIMEOUT;
+}
+
+//USE BLOCK METHOD
+
+void lfs_useBlock(int block) {
+  //the caller holds the log lock
+  lfs_usage[SEGMENT_OF(block)].liveBytes += BLOCK_SIZE;
+}
+
+//FREE BLOCK METHOD
+
+void lfs_freeBlock(int block) {
+  //an overwritten or removed block no longer counts for its segment
+  if(block == -1) {
+    return;
+  }
+  pthread_mutex_lock(&lfs_logLock);
+  lfs_usage[SEGMENT_OF(block)].liveBytes -= BLOCK_SIZE;
+  pthread_mutex_unlock(&lfs_logLock);
+}
+
+//GET SUMMARY METHOD
+
+lfs_summary *lfs_getSummary(int block) {
+  //the summary entry of a block, in the header of its segment
+  int lfs_segmentStart = SEGMENT_START(SEGMENT_OF(block));
+  
+  return ((lfs_summary *)(lfs_disk_in_memory + ((lfs_segmentStart + SUMMARY_BLOCK) * BLOCK_SIZE))) + (block - lfs_segmentStart);
+}
+
+//IS LIVE METHOD
+
+int lfs_isLive(int block, inode *lfs_inode) {
+  //the summary names the owner, the owner's current pointers decide
+  lfs_summary *lfs_entry;
+  lfs_entry = lfs_getSummary(block);
+  
+  //the ID was given to a new file since the block was written
+  if(lfs_inode->version != lfs_entry->version) {
+    return 0;
+  }
+  
+  if(lfs_entry->kind == SUMMARY_DATA) {
+    return lfs_getBlockPointer(lfs_inode, lfs_entry->index) == block;
+  }
+  if(lfs_entry->kind == SUMMARY_EXTENTS) {
+    return (lfs_inode->flags & INODE_EXTENTS) && lfs_inode->extentPointer == block;
+  }
+  return !(lfs_inode->flags & INODE_EXTENTS) && lfs_getIndirectBlock(lfs_inode, lfs_entry->index, lfs_entry->kind - SUMMARY_INDIRECT + 1) == block;
+}
+
+//WRITE SEGMENT HEADER METHOD
+
+void lfs_writeSegmentHeader(int head, int blocks) {
+  //the summary blocks after the chunk table are filled in as blocks are appended
+  char *lfs_start;
+  lfs_start = lfs_disk_in_memory + (SEGMENT_START(lfs_heads[head].segment) * BLOCK_SIZE);
+  memset(lfs_start, 0, SUMMARY_BLOCK * BLOCK_SIZE);
+  
+  lfs_segmentHeader *lfs_header;
+  lfs_header = (lfs_segmentHeader *) lfs_start;
+  lfs_header->magic = LFS_MAGIC;
+  lfs_header->volume = lfs_volume;
+  lfs_header->sequence = lfs_heads[head].sequence;
+  lfs_header->blocks = blocks;
+  lfs_header->time = time(NULL);
+  lfs_headerSerial++;
+  lfs_header->serial = lfs_headerSerial;
+  
+  //the last inode map written completely, chunks logged since may belong to a map that is still changing
+  //its checksum waits for the checksums of the blocks, the flusher adds them all
+  memcpy(lfs_header->heads, lfs_snapshotHeads, sizeof(lfs_snapshotHeads));
+  memcpy(lfs_start + BLOCK_SIZE, lfs_mapSnapshot, MAP_CHUNKS * sizeof(int));
+}
+
+//FOR EACH BLOCK METHOD
+
+void lfs_forEachBlock(inode *lfs_inode, void (*visit)(int)) {
+  //a file mapped by extents references every block of every run, and the extent block
+  if(lfs_inode->flags & INODE_EXTENTS) {
+    if(lfs_inode->extentPointer == -1) {
+      return;
+    }
+    lfs_extent *lfs_extents;
+    lfs_extents = (lfs_extent *)(lfs_disk_in_memory + (lfs_inode->extentPointer * BLOCK_SIZE));
+    int e;
+    for(e=0; e<lfs_inode->extentCount; e++) {
+      int k;
+      for(k=0; k<lfs_extents[e].length; k++) {
+        visit(lfs_extents[e].block + k);
+      }
+    }
+    visit(lfs_inode->extentPointer);
+    
+    return;
+  }
+  
+  //files and directories both keep blocks behind their pointers
+  int j;
+  for(j=0; j<NUMBER_OF_DATAPOINTERS; j++) {
+    if(lfs_inode->datapointer[j] != -1) {
+      visit(lfs_inode->datapointer[j]);
+    }
+  }
+  lfs_forEachIndirect(lfs_inode->indirectDataPointer, 1, visit);
+  lfs_forEachIndirect(lfs_inode->doubleIndirectDataPointer, 2, visit);
+  lfs_forEachIndirect(lfs_inode->tripleIndirectDataPointer, 3, visit);
+}
+
+//FOR EACH INDIRECT METHOD
+
+void lfs_forEachIndirect(int pointer, int depth, void (*visit)(int)) {
+  if(pointer == -1) {
+    return;
+  }
+  
+  int *lfs_indirectPointersArray;
+  lfs_indirectPointersArray = (int *)(lfs_disk_in_memory + (pointer * BLOCK_SIZE));
+  int l;
+  for(l=0; l<NUMBER_OF_INDIRECTPOINTERS; l++) {
+    if(lfs_indirectPointersArray[l] == -1) {
+      continue;
+    }
+    if(depth > 1) {
+      lfs_forEachIndirect(lfs_indirectPointersArray[l], depth-1, visit);
+    } else {
+      visit(lfs_indirectPointersArray[l]);
+    }
+  }
+  visit(pointer);
+}
+
+//BUILD USAGE METHOD
+
+void lfs_buildUsage(void) {
+  printf("buildUsage method called\n");
+  
+  //segments are as old as their last header
+  int s;
+  for(s=0; s<NUMBER_OF_SEGMENTS; s++) {
+    lfs_segmentHeader *lfs_header;
+    lfs_header = (lfs_segmentHeader *)(lfs_disk_in_memory + (SEGMENT_START(s) * BLOCK_SIZE));
+    lfs_usage[s].liveBytes = 0;
+    lfs_usage[s].modify = 0;
+    lfs_usage[s].clean = 0;
+    if(lfs_validHeader(s)) {
+      lfs_usage[s].modify = lfs_header->time;
+    }
+  }
+  
+  //count the blocks whose owner still points to them, one inode lookup per block
+  for(s=0; s<NUMBER_OF_SEGMENTS; s++) {
+    int h;
+    h = lfs_isHead(s);
+    int lfs_end;
+    lfs_end = h != -1 ? lfs_heads[h].block : lfs_segmentEnd(s);
+    
+    int b;
+    for(b=SEGMENT_START(s)+SEGMENT_HEADER_BLOCKS; b<lfs_end; b++) {
+      lfs_summary *lfs_entry;
+      lfs_entry = lfs_getSummary(b);
+      if(lfs_entry->kind == SUMMARY_MAP) {
+        //a chunk of the inode map is live while the map still names it
+        if(lfs_entry->index >= 0 && lfs_entry->index < MAP_CHUNKS && lfs_mapBlocks[lfs_entry->index] == b) {
+          lfs_useBlock(b);
+        }
+        continue;
+      }
+      if(lfs_entry->kind == SUMMARY_INODE) {
+        //an inode block counts the slots the map still names
+        lfs_usage[s].liveBytes += lfs_liveInodes(b) * (int) sizeof(inode);
+        continue;
+      }
+      if(lfs_entry->ID < 0 || lfs_entry->ID >= NUMBER_OF_INODES || lfs_inodeArray[lfs_entry->ID] == -1) {
+        continue;
+      }
+      if(lfs_isLive(b, lfs_findInode(lfs_inodeArray[lfs_entry->ID], lfs_entry->ID))) {
+        lfs_useBlock(b);
+      }
+    }
+  }
+  
+  //nothing reaches the other segments, they can be reused
+  lfs_cleanCount = 0;
+  for(s=0; s<NUMBER_OF_SEGMENTS; s++) {
+    if(lfs_isHead(s) == -1 && lfs_usage[s].liveBytes == 0) {
+      lfs_usage[s].clean = 1;
+      lfs_cleanCount++;
+    }
+  }
+}
+
+//CLEANER METHOD
+
+int lfs_cleaner(void) {
+  //one batch of victims, never two batches at once
+  if(pthread_mutex_trylock(&lfs_cleanerLock) != 0) {
     return 0;
   }
+  lfs_cleaning = 1;
+  printf("cleaner method called\n");
   
-  //create inode pointer 
-  inode *lfs_inode;
-  lfs_inode = malloc(sizeof(inode));
-  
-  //if the given path is not root, we will recursively find the parent
-  char *lfs_path;
-  lfs_path = malloc(strlen(path)+1);
-  memset(lfs_path, 0, strlen(path)+1);
-  memcpy(lfs_path, path, strlen(path)+1);
-  
-  //find the parent inode
-  int lfs_inodeID;
-  lfs_inodeID = lfs_findInodeID(dirname(lfs_path));
+  //path operations wait, open files are cleaned under their own lock
+  pthread_rwlock_wrlock(&lfs_namespaceLock);
   
-  //get the parent inode
-  memset(lfs_inode, 0, sizeof(inode));
-  memcpy(lfs_inode, lfs_disk_in_memory + (lfs_inodeArray[lfs_inodeID] * BLOCK_SIZE), sizeof(inode));
+  char lfs_victims[NUMBER_OF_SEGMENTS];
+  int lfs_count;
+  lfs_count = lfs_pickVictims(lfs_victims);
+  lfs_cleanerFailed = 0;
   
-  //set the path back to the inode we're searching for
-  memset(lfs_path, 0, strlen(path)+1);
-  memcpy(lfs_path, path, strlen(path)+1);
+  //the victims are read front to back once
+  int s;
+  for(s=0; s<NUMBER_OF_SEGMENTS; s++) {
+    if(lfs_victims[s]) {
+      lfs_adviseSegment(s, MADV_WILLNEED);
+    }
+  }
   
-  //checking the parent inode's datapointers 
-  int i;
-  for (i=0; i<NUMBER_OF_DATAPOINTERS; i++) {
-    if(lfs_inode->datapointer[i] != -1) {
-      //set the path back to the inode we're searching for
-      memset(lfs_path, 0, strlen(path)+1);
-      memcpy(lfs_path, path, strlen(path)+1);
-      
-      if(!strcmp(basename(lfs_path), ((inode *) (lfs_disk_in_memory + (lfs_inodeArray[lfs_inode->datapointer[i]]) * BLOCK_SIZE))->name)) {
-        res = ((inode*) (lfs_disk_in_memory + (lfs_inodeArray[lfs_inode->datapointer[i]] * BLOCK_SIZE)))->ID;
-        free(lfs_inode);
-        free(lfs_path);
-        
-        //return the inode
-        return res;
+  //the summaries of the victims name the owner of every block, group the blocks by owner
+  int *lfs_blocks;
+  lfs_blocks = malloc(lfs_count * BLOCKS_PER_SEGMENT * sizeof(int) + 1);
+  int lfs_total = 0;
+  for(s=0; s<NUMBER_OF_SEGMENTS; s++) {
+    int b;
+    for(b=SEGMENT_START(s)+SEGMENT_HEADER_BLOCKS; b<SEGMENT_START(s)+BLOCKS_PER_SEGMENT && lfs_victims[s]; b++) {
+      lfs_summary *lfs_entry;
+      lfs_entry = lfs_getSummary(b);
+      if(lfs_entry->kind == SUMMARY_MAP) {
+        //a live chunk of the inode map is moved by the checkpoint below
+        pthread_mutex_lock(&lfs_logLock);
+        if(lfs_entry->index >= 0 && lfs_entry->index < MAP_CHUNKS && lfs_mapBlocks[lfs_entry->index] == b) {
+          pthread_rwlock_wrlock(&lfs_mapLock);
+          if(!lfs_mapDirty[lfs_entry->index]) {
+            lfs_mapDirty[lfs_entry->index] = 1;
+            lfs_mapDirtyCount++;
+          }
+          pthread_rwlock_unlock(&lfs_mapLock);
+        }
+        pthread_mutex_unlock(&lfs_logLock);
+        continue;
+      }
+      if(lfs_entry->ID >= 0 && lfs_entry->ID < NUMBER_OF_INODES) {
+        lfs_blocks[lfs_total++] = b;
       }
     }
   }
-  //checking the parent inode's indirectDataPointers
-  if (lfs_inode->indirectDataPointer != -1) {
-    int *lfs_indirectPointersArray;
-    lfs_indirectPointersArray = (int *)(lfs_disk_in_memory + (lfs_inode->indirectDataPointer * BLOCK_SIZE));
-    
-    int j;
-    for(j=0; j<NUMBER_OF_INDIRECTPOINTERS; j++) {
-      if(lfs_indirectPointersArray[i] != -1) {
-        memset(lfs_path, 0, strlen(path)+1);
-        memcpy(lfs_path, path, strlen(path)+1);
-        if(!strcmp(basename(lfs_path),((inode *)(lfs_disk_in_memory + (lfs_inodeArray[lfs_indirectPointersArray[i]])*BLOCK_SIZE))->name)) {
-          res = ((inode *)(lfs_disk_in_memory + (lfs_inodeArray[lfs_indirectPointersArray[i]]*BLOCK_SIZE)))->ID;
-          
-          free(lfs_inode);
-          free(lfs_path);
-          return res;
+  qsort(lfs_blocks, lfs_total, sizeof(int), lfs_compareOwner);
+  
+  //move the blocks each inode still points to, and log the inode once
+  int i = 0;
+  while(i < lfs_total) {
+    int lfs_ID = lfs_getSummary(lfs_blocks[i])->ID;
+    int lfs_last;
+    for(lfs_last = i; lfs_last < lfs_total && lfs_getSummary(lfs_blocks[lfs_last])->ID == lfs_ID; lfs_last++);
+    
+    //a file removed since has nothing live here, unless it is still open, which is handled below
+    int lfs_inodeBlock;
+    pthread_rwlock_rdlock(&lfs_mapLock);
+    lfs_inodeBlock = lfs_inodeArray[lfs_ID];
+    pthread_rwlock_unlock(&lfs_mapLock);
+    lfs_openFile *lfs_file = NULL;
+    if(lfs_inodeBlock != -1) {
+      lfs_file = lfs_pinInode(lfs_ID);
+    }
+    
+    if(lfs_file != NULL) {
+      pthread_rwlock_wrlock(&lfs_file->lock);
+      for(; i < lfs_last; i++) {
+        if(lfs_isLive(lfs_blocks[i], &lfs_file->inode)) {
+          lfs_moveLive(lfs_file, lfs_blocks[i]);
         }
       }
+      if(lfs_flushInode(lfs_file) != 0) {
+        lfs_cleanerFailed = 1;
+      }
+      pthread_rwlock_unlock(&lfs_file->lock);
+      lfs_unpinInode(lfs_file);
     }
+    i = lfs_last;
   }
+  free(lfs_blocks);
   
-  //no inode found
-  free(lfs_inode);
-  free(lfs_path);
-  return -1;
-}
-
-//CREATE INODE METHOD
-
-int lfs_createInode(char * path, int type) {
-  printf("createInode method called\n");
+  //inodes still packed into a victim are logged again, whether or not any of their blocks moved
+  int lfs_ID;
+  for(lfs_ID=0; lfs_ID<NUMBER_OF_INODES && lfs_count > 0; lfs_ID++) {
+    int lfs_inodeBlock;
+    pthread_rwlock_rdlock(&lfs_mapLock);
+    lfs_inodeBlock = lfs_inodeArray[lfs_ID];
+    pthread_rwlock_unlock(&lfs_mapLock);
+    if(lfs_inodeBlock == -1 || !lfs_victims[SEGMENT_OF(lfs_inodeBlock)]) {
+      continue;
+    }
+    
+    lfs_openFile *lfs_file;
+    lfs_file = lfs_pinInode(lfs_ID);
+    pthread_rwlock_wrlock(&lfs_file->lock);
+    lfs_file->dirty = 1;
+    if(lfs_flushInode(lfs_file) != 0) {
+      lfs_cleanerFailed = 1;
+    }
+    pthread_rwlock_unlock(&lfs_file->lock);
+    lfs_unpinInode(lfs_file);
+  }
   
-  //create inode pointer
-  inode *lfs_inode;
-  lfs_inode = malloc(sizeof(inode));
-  memset(lfs_inode, 0, sizeof(inode));
+  //removed files that are still open keep their blocks until release
+  pthread_mutex_lock(&lfs_openLock);
+  int lfs_unlinked = 0;
+  lfs_openFile *lfs_file;
+  for(lfs_file = lfs_unlinkedFiles; lfs_file != NULL && lfs_count > 0; lfs_file = lfs_file->next) {
+    lfs_unlinked++;
+  }
+  lfs_openFile **lfs_files;
+  lfs_files = malloc(lfs_unlinked * sizeof(lfs_openFile *) + 1);
+  lfs_unlinked = 0;
+  for(lfs_file = lfs_unlinkedFiles; lfs_file != NULL && lfs_count > 0; lfs_file = lfs_file->next) {
+    lfs_file->count++;
+    lfs_files[lfs_unlinked++] = lfs_file;
+  }
+  pthread_mutex_unlock(&lfs_openLock);
+  for(i=0; i<lfs_unlinked; i++) {
+    pthread_rwlock_wrlock(&lfs_files[i]->lock);
+    lfs_cleanInode(&lfs_files[i]->inode, lfs_victims);
+    pthread_rwlock_unlock(&lfs_files[i]->lock);
+    lfs_unpinInode(lfs_files[i]);
+  }
+  free(lfs_files);
   
-  //copy the path
-  char *lfs_path;
-  lfs_path = malloc(strlen(path)+1);
-  memset(lfs_path, 0, strlen(path)+1);
-  memcpy(lfs_path, path, strlen(path)+1);
+  //the checkpoint must not name an inode pointing into a victim, the ones still in the table go to the log first
+  int lfs_kept = 0;
+  if(lfs_count > 0) {
+    lfs_kept = lfs_writeBack() != 0;
+  }
   
-  //set the inode type
-  lfs_inode->type = type;
-
-  //set the inode name
-  if(strlen(basename(lfs_path)) < MAX_LENGTH) {
-    memset(lfs_inode->name, 0, strlen(basename(lfs_path)));
-    memcpy(lfs_inode->name, basename(lfs_path), strlen(basename(lfs_path)));
+  //the new locations have to be durable before the victims are overwritten
+  int lfs_cleaned = 0;
+  pthread_mutex_lock(&lfs_logLock);
+  if(lfs_kept || (lfs_count > 0 && lfs_writeCheckpoint() != 0)) {
+    lfs_cleanerFailed = 1;
   }
-  else {
-    memset(lfs_inode->name, 0, strlen(basename(lfs_path)));
-    memcpy(lfs_inode->name, basename(lfs_path), MAX_LENGTH);
+  for(s=0; s<NUMBER_OF_SEGMENTS; s++) {
+    if(lfs_cleanerFailed && lfs_victims[s]) {
+      //some live blocks could not be moved, never reuse the segment before the next mount recounts it
+      fprintf(stderr, "Cleaner: log full while cleaning segment %d\n", s);
+      lfs_usage[s].liveBytes = (BLOCKS_PER_SEGMENT - SEGMENT_HEADER_BLOCKS) * BLOCK_SIZE;
+    } else if(lfs_count > 0 && lfs_isHead(s) == -1 && !lfs_usage[s].clean && lfs_usage[s].liveBytes == 0) {
+      lfs_usage[s].clean = 1;
+      lfs_cleanCount++;
+      lfs_cleaned++;
+      
+      //nothing in a clean segment is read again, its pages can go
+      lfs_adviseSegment(s, MADV_DONTNEED);
+    }
   }
+  pthread_mutex_unlock(&lfs_logLock);
   
-  //set the modify and access stamps
-  lfs_inode->modify = time(NULL);
-  lfs_inode->access = time(NULL);
+  pthread_rwlock_unlock(&lfs_namespaceLock);
+  lfs_cleaning = 0;
+  pthread_mutex_unlock(&lfs_cleanerLock);
   
-  //set the size
-  lfs_inode->size = 0;
+  return lfs_cleaned;
+}
+
+//PICK VICTIMS METHOD
+
+int lfs_pickVictims(char *victims) {
+  memset(victims, 0, NUMBER_OF_SEGMENTS);
   
-  int j;
-  for(j=0; j<NUMBER_OF_DATAPOINTERS; j++) {
-    lfs_inode->datapointer[j] = -1;
+  pthread_mutex_lock(&lfs_logLock);
+  time_t lfs_now = time(NULL);
+  int lfs_usable = (BLOCKS_PER_SEGMENT - SEGMENT_HEADER_BLOCKS) * BLOCK_SIZE;
+  //moved blocks go to their own log head, and from there into clean segments
+  int lfs_free = lfs_cleanCount * lfs_usable;
+  if(lfs_heads[HEAD_COLD].segment != -1) {
+    lfs_free += (SEGMENT_START(lfs_heads[HEAD_COLD].segment) + BLOCKS_PER_SEGMENT - lfs_heads[HEAD_COLD].block) * BLOCK_SIZE;
   }
+  int lfs_count = 0;
   
-  lfs_inode->indirectDataPointer = -1;
-  
-  //find a free space in the array of inodes
-  int i;
-  for(i=0; i<NUMBER_OF_INODES; i++) {
-    if(lfs_inodeArray[i] == -1) {
-      lfs_inode->ID = i;
-      //insert the new inode into the array
-      lfs_inodeArray[i] = lfs_insertData((char *) lfs_inode, sizeof(inode));
-      
-      //set the path back to the inode we're creating
-      memset(lfs_path, 0, strlen(path)+1);
-      memcpy(lfs_path, path, strlen(path)+1);
-      
-      //get the parent inode
-      int lfs_inodeID;
-      lfs_inodeID = lfs_findInodeID(dirname(lfs_path));
-      
-      memset(lfs_inode, 0, sizeof(inode));
-      memcpy(lfs_inode, lfs_disk_in_memory + (lfs_inodeArray[lfs_inodeID] * BLOCK_SIZE), sizeof(inode));
-      
-      //set the parent datapointer
-      int j;
-      for(j=0; j<NUMBER_OF_DATAPOINTERS; j++) {
-        if(lfs_inode->datapointer[j] == -1) {
-          lfs_inode->datapointer[j] = i;
-          
-          //reinsert the parent with the new inode set to its datapointer
-          lfs_inodeArray[lfs_inodeID] = lfs_insertData((char *) lfs_inode, sizeof(inode));
-          
-          free(lfs_inode);
-          free(lfs_path);
-          
-          return 0;
-        }
+  while(lfs_count < CLEAN_BATCH) {
+    //cost-benefit: the emptiest and oldest segments give the most space for the least copying
+    int lfs_best = -1;
+    double lfs_bestScore = 0;
+    int s;
+    for(s=0; s<NUMBER_OF_SEGMENTS; s++) {
+      if(lfs_isHead(s) != -1 || lfs_usage[s].clean || victims[s]) {
+        continue;
       }
-      
-      //set the parent indirectDataPointer
-      if(lfs_inode->indirectDataPointer == -1) {
-        //no indirectDataPointers, need to create array
-        int *lfs_arrayIndirectPointers;
-        lfs_arrayIndirectPointers = malloc(NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
-        int l;
-        for(l=0; l<NUMBER_OF_INDIRECTPOINTERS; l++) {
-          lfs_arrayIndirectPointers[l] = -1;
-        }
-        //set empty array to inode
-        lfs_inode->indirectDataPointer = lfs_insertData((char *) lfs_arrayIndirectPointers, NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
-        
-        free(lfs_arrayIndirectPointers);
+      double u = (double) lfs_usage[s].liveBytes / lfs_usable;
+      //one second more, so segments written in the same second still rank by utilization
+      double age = (double)(lfs_now - lfs_usage[s].modify) + 1;
+      double lfs_score = (1 - u) * age / (1 + u);
+      if(lfs_score > lfs_bestScore) {
+        lfs_best = s;
+        lfs_bestScore = lfs_score;
       }
-      //get the parent indirectDataPointers array
-      int *lfs_indirectPointersArray;
-      lfs_indirectPointersArray = lfs_disk_in_memory + (lfs_inode->indirectDataPointer * BLOCK_SIZE);
-      
-      int m;
-      for(m = 0; m<NUMBER_OF_INDIRECTPOINTERS; m++) {
-        if (lfs_indirectPointersArray[m] == -1) {
-          lfs_indirectPointersArray[m] = i;
-          //set the updated indirectDataPointers array
-          lfs_inode->indirectDataPointer = lfs_insertData((char *) lfs_indirectPointersArray, NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
-          //insert the updated parent inode back into the array
-          lfs_inodeArray[lfs_inodeID] = lfs_insertData((char *) lfs_inode, sizeof(inode));
-          
-          free(lfs_indirectPointersArray);
-          free(lfs_inode);
-          free(lfs_path);
-          
-          return 0;
+    }
+    if(lfs_best == -1) {
+      break;
+    }
+    
+    //a moved block can also rewrite an indirect or extent block, and the inode is logged again
+    int lfs_needed = 2 * lfs_usage[lfs_best].liveBytes + SEGMENT_HEADER_BLOCKS * BLOCK_SIZE;
+    if(lfs_usage[lfs_best].liveBytes > 0 && lfs_needed > lfs_free) {
+      break;
+    }
+    lfs_free -= 2 * lfs_usage[lfs_best].liveBytes;
+    victims[lfs_best] = 1;
+    lfs_count++;
+  }
+  pthread_mutex_unlock(&lfs_logLock);
+  
+  return lfs_count;
+}
+
+//CLEAN INODE METHOD
+
+int lfs_cleanInode(inode *lfs_inode, char *victims) {
+  int lfs_changed = 0;
+  
+  if(lfs_inode->flags & INODE_EXTENTS) {
+    if(lfs_inode->extentPointer == -1) {
+      return 0;
+    }
+    
+    //work from a copy, every moved block rewrites the extent list
+    int lfs_count = lfs_inode->extentCount;
+    lfs_extent *lfs_extents;
+    lfs_extents = malloc(lfs_count * sizeof(lfs_extent) + 1);
+    memcpy(lfs_extents, lfs_disk_in_memory + (lfs_inode->extentPointer * BLOCK_SIZE), lfs_count * sizeof(lfs_extent));
+    
+    int e;
+    for(e=0; e<lfs_count; e++) {
+      int k;
+      for(k=0; k<lfs_extents[e].length; k++) {
+        if(victims[SEGMENT_OF(lfs_extents[e].block + k)]) {
+          int lfs_block;
+          lfs_block = lfs_moveBlock(lfs_extents[e].block + k);
+          if(lfs_block != -1 && lfs_setBlockPointer(lfs_inode, lfs_extents[e].start + k, lfs_block) != 0) {
+            lfs_freeBlock(lfs_block);
+            lfs_cleanerFailed = 1;
+          }
+          lfs_changed = 1;
         }
       }
-    } /*No space for a new inode*/ else {
-      if (i == NUMBER_OF_INODES-1) {
-        free(lfs_inode);
-        free(lfs_path);
-        
-        return -ENOMEM;
+    }
+    free(lfs_extents);
+    
+    //the extent block itself, unless moving the blocks already rewrote it
+    if((lfs_inode->flags & INODE_EXTENTS) && lfs_inode->extentPointer != -1 && victims[SEGMENT_OF(lfs_inode->extentPointer)]) {
+      int lfs_block;
+      lfs_block = lfs_moveBlock(lfs_inode->extentPointer);
+      if(lfs_block != -1) {
+        lfs_freeBlock(lfs_inode->extentPointer);
+        lfs_inode->extentPointer = lfs_block;
       }
+      lfs_changed = 1;
     }
+    
+    return lfs_changed;
   }
   
-  free(lfs_inode);
-  free(lfs_path);
+  //files and directories both keep blocks behind their pointers
+  int j;
+  for(j=0; j<NUMBER_OF_DATAPOINTERS; j++) {
+    if(lfs_inode->datapointer[j] != -1 && victims[SEGMENT_OF(lfs_inode->datapointer[j])]) {
+      int lfs_block;
+      lfs_block = lfs_moveBlock(lfs_inode->datapointer[j]);
+      if(lfs_block != -1) {
+        lfs_freeBlock(lfs_inode->datapointer[j]);
+        lfs_inode->datapointer[j] = lfs_block;
+      }
+      lfs_changed = 1;
+    }
+  }
+  lfs_changed |= lfs_cleanIndirect(&lfs_inode->indirectDataPointer, 1, victims);
+  lfs_changed |= lfs_cleanIndirect(&lfs_inode->doubleIndirectDataPointer, 2, victims);
+  lfs_changed |= lfs_cleanIndirect(&lfs_inode->tripleIndirectDataPointer, 3, victims);
   
-  return 0;
+  return lfs_changed;
 }
 
-//REMOVE INODE METHOD
+//CLEAN INDIRECT METHOD
 
-int lfs_removeInode(char * path) {
-  printf("remove inode method called\n");
-  
-  //find the inode
-  int lfs_inodeID;
-  lfs_inodeID = lfs_findInodeID(path);
-  
-  //find the parent inode
-  int lfs_parentInodeID;
-  lfs_parentInodeID = lfs_findInodeID(dirname(path));
-  
-  //create an inode pointer
-  inode *lfs_inode;
-  lfs_inode = malloc(sizeof(inode));
+int lfs_cleanIndirect(int *pointer, int depth, char *victims) {
+  if(*pointer == -1) {
+    return 0;
+  }
   
-  //get the parent inode
-  memset(lfs_inode, 0, sizeof(inode));
-  memcpy(lfs_inode, lfs_disk_in_memory + (lfs_inodeArray[lfs_parentInodeID] * BLOCK_SIZE), sizeof(inode));
+  int lfs_changed = 0;
+  int *lfs_indirectPointersArray;
+  lfs_indirectPointersArray = malloc(NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
+  memcpy(lfs_indirectPointersArray, lfs_disk_in_memory + (*pointer * BLOCK_SIZE), NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
   
-  //remove the inode datapointer from the parent inode
-  int i;
-  for (i=0; i<NUMBER_OF_DATAPOINTERS; i++) {
-    if(lfs_inode->datapointer[i] == lfs_inodeID) {
-      lfs_inode->datapointer[i] = -1;
+  //the lower levels first, they may move
+  int l;
+  for(l=0; l<NUMBER_OF_INDIRECTPOINTERS; l++) {
+    if(lfs_indirectPointersArray[l] == -1) {
+      continue;
+    }
+    if(depth > 1) {
+      lfs_changed |= lfs_cleanIndirect(&lfs_indirectPointersArray[l], depth-1, victims);
+    } else if(victims[SEGMENT_OF(lfs_indirectPointersArray[l])]) {
+      int lfs_block;
+      lfs_block = lfs_moveBlock(lfs_indirectPointersArray[l]);
+      if(lfs_block != -1) {
+        lfs_freeBlock(lfs_indirectPointersArray[l]);
+        lfs_indirectPointersArray[l] = lfs_block;
+      }
+      lfs_changed = 1;
     }
   }
   
-  //check indirectDataPointers
-  if(lfs_inode->indirectDataPointer != -1) {
-    int *lfs_indirectPointersArray;
-    lfs_indirectPointersArray = lfs_disk_in_memory + (lfs_inode->indirectDataPointer * BLOCK_SIZE);
-    
-    int j;
-    for(j=0; j<NUMBER_OF_INDIRECTPOINTERS; j++) {
-      if(lfs_indirectPointersArray[j] == lfs_inodeID) {
-        lfs_indirectPointersArray[j] = -1;
-        lfs_inode->indirectDataPointer = lfs_insertData((char *) lfs_indirectPointersArray, NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
-      }
+  //an indirect block in the log head takes the new pointers in place, any other one is appended
+  if((lfs_changed || victims[SEGMENT_OF(*pointer)]) && !lfs_updateUnwritten(*pointer, 0, lfs_indirectPointersArray, NUMBER_OF_INDIRECTPOINTERS * sizeof(int))) {
+    lfs_summary *lfs_entry;
+    lfs_entry = lfs_getSummary(*pointer);
+    int lfs_block;
+    lfs_block = lfs_insertData((char *) lfs_indirectPointersArray, NUMBER_OF_INDIRECTPOINTERS * sizeof(int), lfs_entry->ID, lfs_entry->version, lfs_entry->kind, lfs_entry->index);
+    if(lfs_block == -1) {
+      lfs_cleanerFailed = 1;
+    } else {
+      lfs_freeBlock(*pointer);
+      *pointer = lfs_block;
     }
+    lfs_changed = 1;
   }
+  free(lfs_indirectPointersArray);
   
-  //insert the updated parent inode into array of inodes, and remove the original inode from the array
-  lfs_inodeArray[lfs_parentInodeID] = lfs_insertData((char *) lfs_inode, sizeof(inode));
-  lfs_inodeArray[lfs_inodeID] = -1;
+  return lfs_changed;
+}
 
-  free(lfs_inode);
-  
-  return 0;
+//MOVE BLOCK METHOD
+
+int lfs_moveBlock(int block) {
+  //append a copy of a live block to the log with the same owner, the caller points to it and frees the old one
+  lfs_summary *lfs_entry;
+  lfs_entry = lfs_getSummary(block);
+  int res;
+  res = lfs_insertData(lfs_disk_in_memory + (block * BLOCK_SIZE), BLOCK_SIZE, lfs_entry->ID, lfs_entry->version, lfs_entry->kind, lfs_entry->index);
+  if(res == -1) {
+    lfs_cleanerFailed = 1;
+  }
+  return res;
 }
 
-//INSERT DATA METHOD
+//MOVE LIVE METHOD
 
-int lfs_insertData(char * data, int size) {
-  int block;
-  printf("insertData method called\n");
+void lfs_moveLive(lfs_openFile *lfs_file, int block) {
+  //the summary says where the owner points to the block, the caller holds the owner's lock
+  lfs_summary *lfs_entry;
+  lfs_entry = lfs_getSummary(block);
+  lfs_file->dirty = 1;
   
-  block = lfs_block;
-  //insert the data into the disk in memory
-  memset(lfs_disk_in_memory + (lfs_block * BLOCK_SIZE), 0, size);
-  memcpy(lfs_disk_in_memory + (lfs_block * BLOCK_SIZE), data, size);
+  int lfs_block;
+  lfs_block = lfs_moveBlock(block);
+  if(lfs_block == -1) {
+    return;
+  }
   
-  //incriment block
-  lfs_block++;
-   
-  if(lfs_block % (SEGMENT_SIZE / BLOCK_SIZE) == 0) {
-    //have to begin a new segment, write the inode array at the beginning of the segment 
-    memset(lfs_disk_in_memory + (lfs_segment * SEGMENT_SIZE), 0, 32 * BLOCK_SIZE);
-    memcpy(lfs_disk_in_memory + (lfs_segment * SEGMENT_SIZE), lfs_inodeArray, 32 * BLOCK_SIZE);
-    
-    //write segment to file
-    lfs_write_segment(lfs_segment, ((char *)(lfs_disk_in_memory + (lfs_segment * SEGMENT_SIZE))));
-
-    //incriment block by 32 to save space for inode array
-    lfs_block += 32;
-    //incriment segment
-    lfs_segment++;
-    
-    if(lfs_segment == NUMBER_OF_SEGMENTS){
-      //file full, time to loop to beginning
-      lfs_block = 32;
-      lfs_segment = 0;
+  int res = 0;
+  if(lfs_entry->kind == SUMMARY_DATA) {
+    //frees the old block itself
+    res = lfs_setBlockPointer(&lfs_file->inode, lfs_entry->index, lfs_block);
+  } else if(lfs_entry->kind == SUMMARY_EXTENTS) {
+    lfs_file->inode.extentPointer = lfs_block;
+    lfs_freeBlock(block);
+  } else {
+    res = lfs_setIndirectChild(&lfs_file->inode, lfs_entry->index, lfs_entry->kind - SUMMARY_INDIRECT + 1, lfs_block);
+    if(res == 0) {
+      lfs_freeBlock(block);
     }
-    //clean the old inode array
-    lfs_cleaner();
-    
-    return block;
   }
-  return block;
+  
+  if(res != 0) {
+    lfs_freeBlock(lfs_block);
+    lfs_cleanerFailed = 1;
+  }
 }
 
-//CLEANER METHOD
-int lfs_cleaner(void) {
-  printf("cleaner method called\n");
+//COMPARE OWNER METHOD
+
+int lfs_compareOwner(const void *a, const void *b) {
+  //blocks of the same inode together, in log order
+  int lfs_first = *(const int *) a;
+  int lfs_second = *(const int *) b;
+  int lfs_difference = lfs_getSummary(lfs_first)->ID - lfs_getSummary(lfs_second)->ID;
+  if(lfs_difference != 0) {
+    return lfs_difference;
+  }
+  return lfs_first - lfs_second;
+}
+
+//WRITE SEGMENT METHOD
+
+int lfs_write_segment(int segment, int first) {
+  printf("writeSegment method called\n");
   
-  //create an inode pointer
-  inode *lfs_inode;
-  lfs_inode = malloc(sizeof(inode));
+  //the partial segments commits did not write get their checksums, then the summary holding them
+  int lfs_start = SEGMENT_START(segment);
+  lfs_sumPartials(first > lfs_start + SEGMENT_HEADER_BLOCKS ? first : lfs_start + SEGMENT_HEADER_BLOCKS, lfs_start + BLOCKS_PER_SEGMENT);
+  lfs_segmentHeader *lfs_header;
+  lfs_header = (lfs_segmentHeader *)(lfs_disk_in_memory + (lfs_start * BLOCK_SIZE));
+  lfs_header->checksum = lfs_regionChecksum(lfs_header, SEGMENT_HEADER_BLOCKS * BLOCK_SIZE, offsetof(lfs_segmentHeader, checksum));
   
-  //create an empty new array of inodes
-  int *lfs_newinodeArray;
-  lfs_newinodeArray = malloc(NUMBER_OF_INODES * sizeof(inode));
+  //one sequential write of the whole segment, straight from the disk in memory
+  if(first <= lfs_start + SEGMENT_HEADER_BLOCKS) {
+    return lfs_write_blocks(lfs_start, BLOCKS_PER_SEGMENT);
+  }
   
-  //initialize new array of inodes
-  int m;
-  for(m=0; m<NUMBER_OF_INODES; m++) {
-    lfs_inodeArray[m]=-1;
+  //commits already wrote its first partial segments, the header, chunk table and summary were not
+  if(lfs_write_blocks(lfs_start, SEGMENT_HEADER_BLOCKS) != 0) {
+    return 1;
+  }
+  if(first < lfs_start + BLOCKS_PER_SEGMENT) {
+    return lfs_write_blocks(first, lfs_start + BLOCKS_PER_SEGMENT - first);
   }
   
-  //check each inode in the old inode array
-  int i;
-  for (i=0; i<NUMBER_OF_INODES; i++) {
-    if(lfs_inodeArray[i] != -1) {
-      //found an inode. Get the inode
-      memset(lfs_inode, 0, sizeof(inode));
-      memcpy(lfs_inode, lfs_disk_in_memory + (lfs_inodeArray[i] * BLOCK_SIZE), sizeof(inode));
-      
-      if(lfs_inode->type == 0) {
-        //the inode is a directory, copy it over.
-        lfs_newinodeArray[i] = lfs_insertData((char *) lfs_inode, sizeof(inode));
-      } else {
-        //The inode is a file, check its datapointers.
-        int j;
-        for(j=0; j<NUMBER_OF_DATAPOINTERS; j++) {
-          if(lfs_inode->datapointer[j] != -1) {
-            //found data
-            lfs_inode->datapointer[j] = lfs_insertData(lfs_disk_in_memory + (lfs_inode->datapointer[j] * BLOCK_SIZE), BLOCK_SIZE);
-          }
-        }
-        //check indirectDataPointers
-        if(lfs_inode->indirectDataPointer != -1) {
-          //get the indirectDataPointers array
-          int *lfs_indirectPointersArray;
-          lfs_indirectPointersArray = lfs_disk_in_memory + (lfs_inode->indirectDataPointer * BLOCK_SIZE);
-          
-          int k;
-          for(k = 0; k<NUMBER_OF_INDIRECTPOINTERS; k++) {
-            if (lfs_indirectPointersArray[k] != -1) {
-              //found data
-              lfs_indirectPointersArray[k] = lfs_insertData(lfs_disk_in_memory + (lfs_indirectPointersArray[k] * BLOCK_SIZE), BLOCK_SIZE);
-            }
-            
-          }
-        //set the updated indirectDataPointers array
-        lfs_inode->indirectDataPointer = lfs_insertData((char *) lfs_indirectPointersArray, NUMBER_OF_INDIRECTPOINTERS * sizeof(int));
-        
-        free(lfs_indirectPointersArray);
-        }
-        //insert the updated inode into the new inode array
-        lfs_newinodeArray[i] = lfs_insertData((char *) lfs_inode, sizeof(inode));
-      }
+  return 0;
+}
+
+//WRITE BLOCKS METHOD
+
+int lfs_write_blocks(int block, int count) {
+  //a mapped image already is the page cache of the harddisk, write the pages of the range back
+  if(lfs_config.map) {
+    off_t lfs_start = (off_t) block * BLOCK_SIZE;
+    off_t lfs_end = lfs_start + (off_t) count * BLOCK_SIZE;
+    lfs_start -= lfs_start % sysconf(_SC_PAGESIZE);
+    if(msync(lfs_disk_in_memory + lfs_start, lfs_end - lfs_start, MS_SYNC) != 0) {
+      perror("Write Blocks: Could not write the mapped harddisk");
+      return 1;
     }
+    return 0;
   }
-  //overrwite the old inode array with the new updated inode array
-  memset(lfs_inodeArray, 0, NUMBER_OF_INODES);
-  memcpy(lfs_inodeArray, lfs_newinodeArray, NUMBER_OF_INODES);
   
-  free(lfs_newinodeArray);
-  free(lfs_inode);
+  //O_DIRECT only writes whole aligned units, widen the range to them
+  if(lfs_config.direct) {
+    int lfs_unit = DIRECT_ALIGNMENT / BLOCK_SIZE;
+    int lfs_end = block + count;
+    block -= block % lfs_unit;
+    count = ALIGNED_BLOCKS(lfs_end) - block;
+  }
   
+  char *lfs_data;
+  lfs_data = lfs_disk_in_memory + (block * BLOCK_SIZE);
+  off_t lfs_offset = (off_t) block * BLOCK_SIZE;
+  size_t lfs_size = (size_t) count * BLOCK_SIZE;
+  
+  //binary data, write until everything is out
+  size_t done = 0;
+  while(done < lfs_size) {
+    ssize_t res;
+    res = pwrite(lfs_harddisk, lfs_data + done, lfs_size - done, lfs_offset + done);
+    if(res == -1) {
+      if(errno == EINTR) {
+        continue;
+      }
+      perror("Write Blocks: Could not write to harddisk");
+      return 1;
+    }
+    done += res;
+  }
   return 0;
 }
 
-//WRITE SEGMENT METHOD
+//OPEN HARDDISK METHOD
 
-int lfs_write_segment(int segment, const char * data) {
-  printf("writeSegment method called\n");
-  FILE *file;
-  file = fopen(HARDDISK,"w+");
-  if(file == NULL) {
-    perror("Write Segment: Error opening harrdisk file\n");
-    return 1;
+int lfs_openHarddisk(int flags) {
+  //one descriptor is kept open for the lifetime of the mount
+  if(lfs_harddisk != -1) {
+    close(lfs_harddisk);
+  }
+  
+  //the mapping goes through the page cache, O_DIRECT would only bypass it for writes
+  if(lfs_config.map && lfs_config.direct) {
+    fprintf(stderr, "Open Harddisk: O_DIRECT does not apply to a mapped image, using the mapping\n");
+    lfs_config.direct = 0;
+  }
+  
+  if(lfs_config.direct) {
+    lfs_harddisk = open(lfs_config.image, O_RDWR | O_DIRECT | flags, 0666);
+    if(lfs_harddisk != -1) {
+      return 0;
+    }
+    
+    //some file systems, like tmpfs, do not support O_DIRECT
+    if(errno != EINVAL) {
+      return 1;
+    }
+    fprintf(stderr, "Open Harddisk: O_DIRECT not supported, using buffered writes\n");
+    lfs_config.direct = 0;
   }
   
-  char * lfs_segment_data;
-  lfs_segment_data = malloc(SEGMENT_SIZE);
+  lfs_harddisk = open(lfs_config.image, O_RDWR | flags, 0666);
+  if(lfs_harddisk == -1) {
+    return 1;
+  }
+  return 0;
+}
 
-  memset(lfs_segment_data, 0, SEGMENT_SIZE);
-  memcpy(lfs_segment_data, data, SEGMENT_SIZE);
+//MAP HARDDISK METHOD
+
+int lfs_mapHarddisk(void) {
+  //the image is shared with the harddisk file, no private copy of the volume is kept
+  if(lfs_mappedSize != 0) {
+    munmap(lfs_disk_in_memory, lfs_mappedSize);
+    lfs_mappedSize = 0;
+  }
   
-  if(fseek(file, (segment * SEGMENT_SIZE), SEEK_SET) != 0) {
-    perror("Write Segment: Could not set stream position in harddisk");
+  void *lfs_map;
+  lfs_map = mmap(NULL, IMAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, lfs_harddisk, 0);
+  if(lfs_map == MAP_FAILED) {
+    perror("Map Harddisk: Could not map the harddisk");
     return 1;
   }
-  fputs(lfs_segment_data, file);
-  fclose(file);
+  lfs_disk_in_memory = lfs_map;
+  lfs_mappedSize = IMAGE_SIZE;
+  
   return 0;
 }
 
+//ADVISE SEGMENT METHOD
+
+void lfs_adviseSegment(int segment, int advice) {
+  //tell the kernel how a segment of a mapped image is about to be used
+  if(lfs_mappedSize == 0) {
+    return;
+  }
+  madvise(lfs_disk_in_memory + (SEGMENT_START(segment) * BLOCK_SIZE), SEGMENT_SIZE, advice);
+}
+
 //UTIME METHOD
 
 int lfs_utime(const char * path, struct utimbuf * utime) {
   printf("utime method called\n");
   
-  //create an inode pointer
-  inode *lfs_inode;
-  lfs_inode = malloc(sizeof(inode));
-  
-  //find the inode
-  int lfs_inodeID;
-  lfs_inodeID = lfs_findInodeID(path);
-  
   //get the inode
-  memset(lfs_inode, 0, sizeof(inode));
-  memcpy(lfs_inode, lfs_disk_in_memory + (lfs_inodeArray[lfs_inodeID] * BLOCK_SIZE), sizeof(inode));
+  lfs_openFile *lfs_file;
+  lfs_file = lfs_getOpenFile(path, NULL);
+  if(lfs_file == NULL) {
+    return -ENOENT;
+  }
   
-  //set the access time
+  //set both times, the current time when none are given
+  pthread_rwlock_wrlock(&lfs_file->lock);
   if(utime != NULL) {
-    lfs_inode->modify = time(NULL);
-    lfs_inode->access = utime->actime;
+    lfs_file->inode.modify = utime->modtime;
+    lfs_file->inode.access = utime->actime;
   } else {
-    lfs_inode->modify = time(NULL);
-    lfs_inode->access = time(NULL);
+    lfs_file->inode.modify = time(NULL);
+    lfs_file->inode.access = time(NULL);
   }
+  lfs_file->dirty = 1;
+  pthread_rwlock_unlock(&lfs_file->lock);
   
-  //insert the updated inode into the array of inodes
-  lfs_inodeArray[lfs_inodeID] = lfs_insertData((char *) lfs_inode, sizeof(inode));
-  
-  free(lfs_inode);
+  //the inode is logged by a write back once nobody holds it anymore
+  lfs_unpinInode(lfs_file);
   
   return 0;
 }
 
 int main( int argc, char *argv[] ) {
-  lfs_init();
-	fuse_main( argc, argv, &lfs_oper );
+  int res;
+  struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+  
+  //take out the lfs options, the rest goes to fuse
+  if(fuse_opt_parse(&args, &lfs_config, lfs_opts, NULL) == -1) {
+    return 1;
+  }
+  if(lfs_config.image == NULL) {
+    lfs_config.image = strdup(HARDDISK);
+  }
+  
+  //fuse changes to / when it daemonizes, so keep an absolute image path
+  if(lfs_config.image[0] != '/') {
+    char lfs_cwd[4096];
+    if(getcwd(lfs_cwd, sizeof(lfs_cwd)) != NULL) {
+      char *lfs_image;
+      lfs_image = malloc(strlen(lfs_cwd) + strlen(lfs_config.image) + 2);
+      sprintf(lfs_image, "%s/%s", lfs_cwd, lfs_config.image);
+      free(lfs_config.image);
+      lfs_config.image = lfs_image;
+    }
+  }
+  lfs_useExtents = !lfs_config.noExtents;
+  lfs_initChecksum();
+  
+  //a check of the image runs on its own and never mounts it
+  if(lfs_config.verify) {
+    fuse_opt_free_args(&args);
+    
+    return lfs_verify();
+  }
+  
+  if(lfs_init() != 0) {
+    return 1;
+  }
+	res = fuse_main(args.argc, args.argv, &lfs_oper, NULL);
+	
+	fuse_opt_free_args(&args);
 
-	return 0;
-}
\ No newline at end of file
+	return res;
+}